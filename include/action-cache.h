@@ -0,0 +1,66 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "exception.h"
+
+namespace action_cache {
+
+class ActionCacheException : public RuntimeException {
+   public:
+    ActionCacheException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Local content-addressed cache of recipe outputs.
+ *
+ * Layout under the cache directory:
+ * - `blobs/<content hash>`: read-only copies of produced target files.
+ * - `actions/<action key>`: manifest, one `<content hash> <target>` per line.
+ *
+ * Entries are written to a temporary file and renamed into place, so several
+ * TinyMake processes can share one cache directory.
+ */
+class ActionCache {
+   public:
+    explicit ActionCache(const std::filesystem::path& cacheDir_);
+
+    /**
+     * @brief Key of the action performed by `rule`: its targets, fully
+     * expanded recipes, and the content digest of every prerequisite (or just
+     * the name for prerequisites that are not files).
+     */
+    std::string actionKey(const auto_var_replacement::Rule& rule) const;
+
+    /**
+     * @brief Restores all targets recorded under `key` as reflinks where the
+     * filesystem supports them, plain copies otherwise. Restored targets are
+     * writable, share no inode with the cache, and get a fresh mtime.
+     *
+     * @return false on a cache miss, in which case no target is touched. A
+     * blob whose content doesn't match its hash is removed and is a miss.
+     */
+    bool restore(const std::string& key) const;
+
+    /**
+     * @brief Records `targets` as the outputs of `key`. Nothing is recorded
+     * unless every target is a regular file, so phony rules are never cached.
+     */
+    void store(const std::string& key,
+               const std::vector<std::string>& targets) const;
+
+   private:
+    std::filesystem::path cacheDir;
+
+    std::filesystem::path blobPath(const std::string& contentHash) const;
+    std::filesystem::path manifestPath(const std::string& key) const;
+    std::optional<std::vector<std::pair<std::string, std::string>>>
+    readManifest(const std::string& key) const;
+};
+}  // namespace action_cache
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <variant>
@@ -10,11 +11,20 @@
 
 namespace auto_var_replacement {
 
+/**
+ * @brief Fully expanded rule, each recipe is a shell command line.
+ */
 struct Rule final {
     std::vector<std::string> targets;
     std::vector<std::string> prereqs;
     std::vector<std::string> recipes;
     size_t lineno;
+    // For a single-line recipe using automatic variables: the line before
+    // their expansion, which is the same for rules that only differ in their
+    // targets and prerequisites, and the offset in `recipes[0]` of the first
+    // word using one. Empty otherwise.
+    std::string recipeTemplate;
+    size_t argsOffset = 0;
 
     Rule(const std::vector<std::string>& targets_,
          const std::vector<std::string>& prereqs_,
@@ -26,12 +36,28 @@ struct Rule final {
     std::string toString() const {
         std::string result;
         result += "(Rule:";
-
-        result += ")";
+        result += "(Targets:";
+        for (const auto& t : targets) {
+            result += ' ' + t;
+        }
+        result += ")(Prerequisites:";
+        for (const auto& p : prereqs) {
+            result += ' ' + p;
+        }
+        result += ")(Recipes:";
+        for (const auto& r : recipes) {
+            result += " (" + r + ")";
+        }
+        result += "))";
         return result;
     };
 };
 
+/**
+ * @brief Expands `$@` to the first target, `$<` to the first prerequisite and
+ * `$^` to all prerequisites without duplicates. Strings are re-quoted for
+ * the shell.
+ */
 std::shared_ptr<Rule> replace(
     const std::shared_ptr<var_replacement::Rule>& rule);
 }  // namespace auto_var_replacement
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "exception.h"
+
+namespace batch {
+
+class BatchException : public RuntimeException {
+   public:
+    BatchException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Special target whose prerequisites are the targets that may be built
+ * in batches, e.g. `.BATCH: a.lint b.lint`.
+ */
+inline constexpr std::string_view SPECIAL_TARGET = ".BATCH";
+
+/**
+ * @brief Removes the `.BATCH` rules from `rules`.
+ *
+ * @return Whether each remaining rule builds a target listed in `.BATCH`.
+ * Listed targets without a rule are ignored.
+ * @throw BatchException if a listed target's rule has no single-line recipe
+ * using automatic variables, see `auto_var_replacement::Rule`.
+ */
+std::vector<bool> takeBatchable(
+    std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules);
+
+/**
+ * @brief Single command running the recipes of `rules`, which share their
+ * recipe template: the words before the first automatic variable, followed by
+ * the remaining words of every rule in order.
+ *
+ * E.g. `lint --fix $<` for `a.c` and `b.c` becomes `lint --fix a.c b.c`.
+ */
+std::string combinedCommand(
+    const std::vector<const auto_var_replacement::Rule*>& rules);
+}  // namespace batch
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "driver.h"
+#include "exception.h"
+
+namespace build_server {
+
+class BuildServerException : public RuntimeException {
+   public:
+    BuildServerException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Unix socket the server listens on, relative to the directory both the
+ * server and its clients are started from.
+ */
+inline const std::filesystem::path SOCKET_PATH = ".tinymake.sock";
+
+class Watcher;
+
+/**
+ * @brief Build server listening on a Unix socket, keeping one
+ * `driver::Session` warm across the client invocations it serves.
+ *
+ * The directories of every Makefile read so far and of every file in the
+ * session's dependency graph are watched with inotify. A change to a file in
+ * them invalidates what the session cached about that file, so the next
+ * request neither re-parses unchanged Makefiles, nor rebuilds the graph
+ * unless a Makefile changed, nor re-stats unchanged files.
+ *
+ * Protocol: the client sends its command line arguments, each terminated by
+ * '\0', then shuts down its write side. The server replies with one byte
+ * holding the exit status, the length of the error output in decimal and
+ * '\n', the error output, then the output of the run.
+ */
+class Server {
+   public:
+    Server(size_t concurrency, const std::filesystem::path& socketPath);
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    /**
+     * @brief Waits for one request and serves it.
+     *
+     * @return false if SIGINT/SIGTERM arrived before a request.
+     */
+    bool serveNext();
+
+    driver::Session session;
+
+   private:
+    std::filesystem::path socketPath;
+    std::unique_ptr<Watcher> watcher;
+    int listener;
+};
+
+/**
+ * @brief Serves client invocations on `socketPath` until SIGINT/SIGTERM.
+ */
+void serve(size_t concurrency, const std::filesystem::path& socketPath);
+
+/**
+ * @brief Runs the invocation `args` on the server listening on `socketPath`,
+ * copying its output to `out` and its error output to `err`.
+ *
+ * Invocations from inside a recipe are never forwarded: the server is busy
+ * running that recipe and would not answer.
+ *
+ * @return The exit status, or nothing if no server is listening or the
+ * caller is a recipe.
+ */
+std::optional<int> forward(const std::filesystem::path& socketPath,
+                           const std::vector<std::string>& args,
+                           std::ostream& out, std::ostream& err);
+}  // namespace build_server
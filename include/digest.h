@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "exception.h"
+
+namespace digest {
+
+class DigestException : public RuntimeException {
+   public:
+    DigestException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Incremental 128-bit FNV-1a hash.
+ *
+ * Not cryptographic, but wide enough that accidental collisions between build
+ * artifacts are not a practical concern.
+ */
+class Hasher {
+   public:
+    Hasher& update(std::string_view data);
+    /**
+     * @brief Hashes the length before the data, so that the concatenation of
+     * several fields can't collide with a different split of the same bytes.
+     */
+    Hasher& updateField(std::string_view data);
+    std::string hexDigest() const;
+
+   private:
+    static constexpr unsigned __int128 OFFSET_BASIS =
+        (static_cast<unsigned __int128>(0x6c62272e07bb0142ULL) << 64) |
+        0x62b821756295c58dULL;
+
+    unsigned __int128 state = OFFSET_BASIS;
+};
+
+std::string hashString(std::string_view data);
+
+/**
+ * @brief Hex digest of the content of the file at `path`.
+ *
+ * @throw DigestException if the file can't be read.
+ */
+std::string hashFile(const std::filesystem::path& path);
+}  // namespace digest
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "makefile-loader.h"
+#include "rule-dep.h"
+#include "rule-filter.h"
+#include "thread-pool.h"
+
+namespace driver {
+
+struct Options {
+    size_t concurrency = 1;
+    std::filesystem::path makefilePath = "Makefile";
+    std::vector<std::string> targets;
+    bool daemon = false;
+    // Print the output of each pass instead of building (`--dump`).
+    bool dump = false;
+    // Action and parse cache directory (`--cache-dir`), no caching across
+    // runs if unset.
+    std::optional<std::filesystem::path> cacheDir;
+    // Where to write the per-pass JSON report (`--stats`), "-" for `out`.
+    std::optional<std::filesystem::path> statsPath;
+    // File listing changed paths, one per line (`--affected-by`).
+    std::optional<std::filesystem::path> affectedBy;
+    // Only build part `shardIndex` (0-based) of `numShards` (`--shard i/N`,
+    // where i is 1-based).
+    size_t shardIndex = 0;
+    size_t numShards = 1;
+    // How long a shard waits for a prerequisite built by another shard
+    // (`--shard-timeout`, in seconds).
+    std::chrono::seconds shardTimeout{600};
+    // Most rules listed in `.BATCH` run by one command (`--batch-size`).
+    size_t batchSize = 100;
+};
+
+/**
+ * @throw std::runtime_error on malformed arguments.
+ */
+Options parseOptions(const std::vector<std::string>& commandLineArgs);
+
+/**
+ * @brief Output of passes 1-6 for one Makefile and the mtimes of the files
+ * of its graph, kept by a `Session` for later builds.
+ */
+struct BuildState {
+    BuildState(
+        const std::filesystem::path& makefilePath_,
+        std::vector<std::shared_ptr<auto_var_replacement::Rule>>&& rules_,
+        std::vector<bool>&& batchable_, rule_dep::Graph&& graph_,
+        rule_dep::Levelization&& levelization_)
+        : makefilePath(makefilePath_),
+          rules(std::move(rules_)),
+          batchable(std::move(batchable_)),
+          graph(std::move(graph_)),
+          levelization(std::move(levelization_)),
+          mtimes(graph.numNodes()) {}
+
+    std::filesystem::path makefilePath;
+    std::vector<std::shared_ptr<auto_var_replacement::Rule>> rules;
+    std::vector<bool> batchable;
+    rule_dep::Graph graph;
+    rule_dep::Levelization levelization;
+    rule_filter::MtimeTable mtimes;
+    // Whether the directories of all Makefiles were watched when it was
+    // built, only then can it be reused.
+    bool reusable = false;
+    // Absolute path of every node and nodes by absolute directory, only
+    // filled while some directory is watched.
+    std::unordered_map<std::string, rule_dep::NodeId> nodeOfPath;
+    std::unordered_map<std::string, std::vector<rule_dep::NodeId>> nodesInDir;
+};
+
+/**
+ * @brief State that may outlive a single run, e.g. in a build server.
+ *
+ * Cached state is only reused for files in watched directories (see
+ * `setWatched`), so a session nobody reports changes to re-reads and
+ * re-stats everything on each run, like a fresh one.
+ */
+class Session {
+   public:
+    explicit Session(size_t concurrency) : pool(concurrency) {}
+
+    /**
+     * @brief Forgets everything cached about the file at `path`: a changed
+     * Makefile drops the build state, any other file just its node's mtime.
+     * Dependents are re-checked against the new mtime by the next build.
+     */
+    void invalidate(const std::filesystem::path& path);
+
+    /**
+     * @brief Absolute directories of the Makefiles read so far and of the
+     * files of the build state's graph.
+     */
+    std::vector<std::filesystem::path> directories();
+
+    /**
+     * @brief Records whether every change to a file directly in `dir` is
+     * reported to `invalidate` from now on.
+     */
+    void setWatched(const std::filesystem::path& dir, bool watched);
+
+    /**
+     * @brief Makes `state` the build state, computing its reusability and
+     * which of its nodes are watched.
+     */
+    void setBuildState(std::unique_ptr<BuildState> state);
+
+    makefile_loader::ParseCache parseCache;
+    std::unique_ptr<BuildState> buildState;
+    // Declared last so that it is destroyed (and joined) first, while the
+    // caches its tasks may reference are still alive.
+    thread_pool::ThreadPool pool;
+
+   private:
+    std::unordered_set<std::string> watchedDirs;
+
+    void indexPaths(BuildState& state) const;
+};
+
+/**
+ * @brief Runs all passes for `options`, building the requested targets and
+ * writing the recipes run and their output to `out`.
+ *
+ * With `affectedBy` set, nothing is built: the targets that depend on any of
+ * the listed paths are written to `out` instead, one per line.
+ *
+ * With more than one shard, the goals are split by `partition::partitionGoals`
+ * and only the ones of shard `shardIndex` are built.
+ */
+void run(const Options& options, Session& session, std::ostream& out);
+
+/**
+ * @brief Writes `error` to `err` the way TinyMake reports a failed run,
+ * whether it ran in-process or on a build server.
+ */
+void reportError(const std::exception& error, std::ostream& err);
+}  // namespace driver
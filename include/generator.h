@@ -0,0 +1,107 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+/**
+ * @brief Minimal single-pass coroutine generator (`std::generator` is C++23).
+ *
+ * Example:
+ * Generator<int> count() { for (int i = 0; i < 3; i++) co_yield i; }
+ * for (int i : count()) { ... }
+ *
+ * An exception thrown inside the coroutine is rethrown to the consumer at the
+ * point where it advances the generator.
+ */
+template <typename T>
+class Generator {
+   public:
+    struct promise_type {
+        std::optional<T> current;
+        std::exception_ptr exception;
+
+        Generator get_return_object() {
+            return Generator(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T value) {
+            current = std::move(value);
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    class Iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+        explicit Iterator(std::coroutine_handle<promise_type> handle_)
+            : handle(handle_) {}
+
+        T& operator*() const { return *handle.promise().current; }
+        T* operator->() const { return &*handle.promise().current; }
+        Iterator& operator++() {
+            advance(handle);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const {
+            return !handle || handle.done();
+        }
+
+       private:
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    explicit Generator(std::coroutine_handle<promise_type> handle_)
+        : handle(handle_) {}
+    Generator(Generator&& other) noexcept
+        : handle(std::exchange(other.handle, {})) {}
+    Generator& operator=(Generator&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+    ~Generator() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    /**
+     * @brief Starts (or continues) the coroutine, can only be iterated once.
+     */
+    Iterator begin() {
+        advance(handle);
+        return Iterator(handle);
+    }
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+
+   private:
+    std::coroutine_handle<promise_type> handle;
+
+    static void advance(std::coroutine_handle<promise_type> handle) {
+        handle.promise().current.reset();
+        handle.resume();
+        if (handle.promise().exception) {
+            std::rethrow_exception(
+                std::exchange(handle.promise().exception, {}));
+        }
+    }
+};
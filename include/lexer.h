@@ -1,12 +1,13 @@
 #pragma once
 
 #include <cstddef>
-#include <memory>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
 #include "exception.h"
+#include "generator.h"
 
 namespace lexer {
 
@@ -16,36 +17,34 @@ class LexerException : public RuntimeException {
         : RuntimeException(whatArgs) {}
 };
 
-enum TokenType { WORD, VAR, AUTO_VAR, STRING, EQUAL, COLON, TAB, ENDL };
-
-struct Token {
-    size_t lineno;
-    Token(size_t lineno_) : lineno(lineno_) {}
-    virtual ~Token() = default;
-    virtual TokenType tokenType() const = 0;
-    virtual std::string toString() const = 0;
-};
-
-struct Word final : public Token {
+struct Word final {
     std::string name;
-
-    explicit Word(const std::string& name_, size_t lineno)
-        : Token(lineno), name(name_) {}
-    TokenType tokenType() const override { return WORD; }
-    std::string toString() const override { return "(Word " + name + ")"; }
+    size_t lineno;
+    // Whether the token directly follows the previous word-like token (`Word`,
+    // `Var`, `AutoVar` or `String`) with no whitespace in between, so that
+    // their expansions form a single word, e.g. `$(DIR)/$@`.
+    bool joined = false;
+
+    explicit Word(const std::string& name_, size_t lineno_)
+        : name(name_), lineno(lineno_) {}
+    std::string toString() const { return "(Word " + name + ")"; }
 };
 
-struct Var final : public Token {
+struct Var final {
     std::string name;
+    size_t lineno;
+    bool joined = false;  // See `Word::joined`.
 
-    explicit Var(const std::string& name_, size_t lineno)
-        : Token(lineno), name(name_) {}
-    TokenType tokenType() const override { return VAR; }
-    std::string toString() const override { return "(Var " + name + ")"; }
+    explicit Var(const std::string& name_, size_t lineno_)
+        : name(name_), lineno(lineno_) {}
+    std::string toString() const { return "(Var " + name + ")"; }
 };
 
-struct AutoVar final : public Token {
+struct AutoVar final {
     enum Type { DOLLAR_AT, DOLLAR_LT, DOLLAR_SUP } type;
+    size_t lineno;
+    bool joined = false;  // See `Word::joined`.
+
     static std::string typeToString(Type type) {
         switch (type) {
             case DOLLAR_AT:
@@ -58,22 +57,29 @@ struct AutoVar final : public Token {
         throw LexerException({"unreachable"});
     }
 
-    explicit AutoVar(Type type_, size_t lineno) : Token(lineno), type(type_) {}
-    TokenType tokenType() const override { return VAR; }
-    std::string toString() const override {
+    explicit AutoVar(Type type_, size_t lineno_)
+        : type(type_), lineno(lineno_) {}
+    std::string toString() const {
         return "(AutoVar " + typeToString(type) + ")";
     }
 };
 
-struct String final : public Token {
-    std::vector<std::variant<std::string, Var, AutoVar>> segments;
+// `$$` inside a string: a `$` passed on to the shell, so that `"$$HOME"`
+// expands there.
+struct Dollar final {
+    std::string toString() const { return "(Dollar)"; }
+};
+
+struct String final {
+    using Segment = std::variant<std::string, Var, AutoVar, Dollar>;
 
-    explicit String(
-        const std::vector<std::variant<std::string, Var, AutoVar>>& segments_,
-        size_t lineno)
-        : Token(lineno), segments(segments_) {}
-    TokenType tokenType() const override { return STRING; }
-    std::string toString() const override {
+    std::vector<Segment> segments;
+    size_t lineno;
+    bool joined = false;  // See `Word::joined`.
+
+    explicit String(const std::vector<Segment>& segments_, size_t lineno_)
+        : segments(segments_), lineno(lineno_) {}
+    std::string toString() const {
         std::string result("(String ");
         for (const auto& seg : segments) {
             if (std::holds_alternative<std::string>(seg)) {
@@ -82,6 +88,8 @@ struct String final : public Token {
                 result += std::get<Var>(seg).toString();
             } else if (std::holds_alternative<AutoVar>(seg)) {
                 result += std::get<AutoVar>(seg).toString();
+            } else {
+                result += std::get<Dollar>(seg).toString();
             }
         }
         result += ')';
@@ -89,29 +97,56 @@ struct String final : public Token {
     }
 };
 
-struct Equal final : public Token {
-    Equal(size_t lineno) : Token(lineno) {}
-    TokenType tokenType() const override { return EQUAL; }
-    std::string toString() const override { return "(Equal)"; }
+struct Equal final {
+    size_t lineno;
+
+    explicit Equal(size_t lineno_) : lineno(lineno_) {}
+    std::string toString() const { return "(Equal)"; }
 };
 
-struct Colon final : public Token {
-    Colon(size_t lineno) : Token(lineno) {}
-    TokenType tokenType() const override { return COLON; }
-    std::string toString() const override { return "(Colon)"; }
+struct Colon final {
+    size_t lineno;
+
+    explicit Colon(size_t lineno_) : lineno(lineno_) {}
+    std::string toString() const { return "(Colon)"; }
 };
 
-struct Tab final : public Token {
-    Tab(size_t lineno) : Token(lineno) {}
-    TokenType tokenType() const override { return TAB; }
-    std::string toString() const override { return "(Tab)"; }
+struct Tab final {
+    size_t lineno;
+
+    explicit Tab(size_t lineno_) : lineno(lineno_) {}
+    std::string toString() const { return "(Tab)"; }
 };
 
-struct Endl final : public Token {
-    Endl(size_t lineno) : Token(lineno) {}
-    TokenType tokenType() const override { return ENDL; }
-    std::string toString() const override { return "(Endl)"; }
+struct Endl final {
+    size_t lineno;
+
+    explicit Endl(size_t lineno_) : lineno(lineno_) {}
+    std::string toString() const { return "(Endl)"; }
 };
 
-std::vector<std::shared_ptr<Token>> lex(const std::string& input);
+/**
+ * @brief Closed set of tokens, stored by value. Check the kind with
+ * `std::holds_alternative`/`std::get_if` and dispatch with `std::visit`.
+ */
+using Token = std::variant<Word, Var, AutoVar, String, Equal, Colon, Tab, Endl>;
+
+inline std::string toString(const Token& token) {
+    return std::visit([](const auto& t) { return t.toString(); }, token);
+}
+
+inline size_t linenoOf(const Token& token) {
+    return std::visit([](const auto& t) { return t.lineno; }, token);
+}
+
+/**
+ * @brief Lazily lexes `input` one logical line at a time.
+ *
+ * Each yielded vector holds the tokens of one logical line (backslash-newline
+ * continuations included), ending with its `Endl` token unless it is the last
+ * line of the input. `input` must outlive the generator.
+ */
+Generator<std::vector<Token>> lexLines(std::string_view input);
+
+std::vector<Token> lex(const std::string& input);
 }  // namespace lexer
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "exception.h"
+#include "parser.h"
+#include "thread-pool.h"
+
+namespace makefile_loader {
+
+class LoaderException : public RuntimeException {
+   public:
+    LoaderException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Reads the whole file at `path`.
+ *
+ * @throw LoaderException if the file can't be opened.
+ */
+std::string readFile(const std::filesystem::path& path);
+
+/**
+ * @brief Thread-safe cache of parsed Makefiles.
+ *
+ * An entry is reused as long as the file's mtime is unchanged; if the mtime
+ * changed, the file is re-read and only re-parsed if its content hash
+ * changed too. Keeping one instance alive (e.g. in a long-running process)
+ * lets unchanged fragments be reused across loads, and a cache directory
+ * (see `setDirectory`) lets them be reused across runs.
+ */
+class ParseCache {
+   public:
+    std::shared_ptr<const std::vector<parser::Statement>> get(
+        const std::filesystem::path& path);
+
+    /**
+     * @brief Persists entries under `dir`, one file per Makefile named by the
+     * hash of its absolute path, and falls back to them on a miss. Nothing is
+     * persisted if `dir` is unset. Must not be called while loading.
+     */
+    void setDirectory(const std::optional<std::filesystem::path>& dir);
+
+    /**
+     * @brief Remembers that the optional include `path` was missing, so that
+     * its creation shows up in `paths`.
+     */
+    void recordMissing(const std::filesystem::path& path);
+
+    /**
+     * @brief Drops the entry of `path`, if any.
+     *
+     * @return Whether `path` was cached or recorded as missing.
+     */
+    bool invalidate(const std::filesystem::path& path);
+
+    /**
+     * @brief Absolute paths of all cached files and recorded missing ones,
+     * i.e. the files whose changes can change the result of a load.
+     */
+    std::vector<std::filesystem::path> paths() const;
+
+    /**
+     * @brief Number of tokens lexed by this cache, cache hits excluded.
+     */
+    uint64_t tokensLexed() const { return numTokensLexed.load(); }
+
+   private:
+    struct Entry {
+        std::filesystem::file_time_type mtime;
+        std::string contentHash;
+        std::shared_ptr<const std::vector<parser::Statement>> statements;
+    };
+
+    std::optional<Entry> readPersisted(const std::string& key) const;
+    void persist(const std::string& key, const Entry& entry) const;
+
+    std::atomic<uint64_t> numTokensLexed = 0;
+    std::optional<std::filesystem::path> directory;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_set<std::string> missing;
+};
+
+/**
+ * @brief Lexes and parses `makefile` and everything it includes.
+ *
+ * Files included by `makefile` itself are loaded concurrently on `pool`
+ * (nested includes are expanded by the task that found them). The result is
+ * merged in source order, as if each `include` line was replaced by the
+ * content of the included files.
+ */
+std::pair<std::vector<parser::VarDef>, std::vector<parser::Rule>> load(
+    const std::filesystem::path& makefile, thread_pool::ThreadPool& pool,
+    ParseCache& cache);
+}  // namespace makefile_loader
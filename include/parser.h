@@ -1,13 +1,13 @@
 #pragma once
 
 #include <cstddef>
-#include <memory>
 #include <string>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "exception.h"
+#include "generator.h"
 #include "lexer.h"
 
 namespace parser {
@@ -18,23 +18,14 @@ class ParserException : public RuntimeException {
         : RuntimeException(whatArgs) {}
 };
 
-enum ASTType { VAR_DEF, RULE };
-
-struct AST {
-    virtual ~AST() = default;
-    virtual ASTType tokenType() const = 0;
-    virtual std::string toString() const = 0;
-};
-
-struct VarDef final : public AST {
+struct VarDef final {
     lexer::Word varName;
     std::vector<std::variant<lexer::Word, lexer::Var>> values;
 
     VarDef(const lexer::Word& varName_,
            const std::vector<std::variant<lexer::Word, lexer::Var>>& values_)
         : varName(varName_), values(values_) {}
-    ASTType tokenType() const override { return VAR_DEF; }
-    std::string toString() const override {
+    std::string toString() const {
         std::string result;
         result += "(Variable Assignment: ";
         result += "(Variable Name: " + varName.toString() + ")";
@@ -55,7 +46,7 @@ struct VarDef final : public AST {
     };
 };
 
-struct Rule final : public AST {
+struct Rule final {
     std::vector<std::variant<lexer::Word, lexer::Var>> targets;
     std::vector<std::variant<lexer::Word, lexer::Var>> prereqs;
     std::vector<std::vector<
@@ -68,8 +59,7 @@ struct Rule final : public AST {
         const std::vector<std::vector<std::variant<
             lexer::Word, lexer::Var, lexer::AutoVar, lexer::String>>>& recipes_)
         : targets(targets_), prereqs(prereqs_), recipes(recipes_) {}
-    ASTType tokenType() const override { return RULE; }
-    std::string toString() const override {
+    std::string toString() const {
         std::string result;
         result += "(Rule:";
 
@@ -117,6 +107,53 @@ struct Rule final : public AST {
     };
 };
 
+/**
+ * @brief `include` or `-include` directive, the latter ignores missing files.
+ *
+ * Paths are plain words: included files are loaded before any variable is
+ * resolved, so `include $(DIR)/x.mk` is rejected.
+ */
+struct Include final {
+    std::vector<lexer::Word> paths;
+    bool optional;
+    size_t lineno;
+
+    Include(const std::vector<lexer::Word>& paths_, bool optional_,
+            size_t lineno_)
+        : paths(paths_), optional(optional_), lineno(lineno_) {}
+    std::string toString() const {
+        std::string result;
+        result += optional ? "(Optional Include:" : "(Include:";
+        for (const auto& p : paths) {
+            result += ' ' + p.toString();
+        }
+        result += ")";
+        return result;
+    };
+};
+
+/**
+ * @brief Closed set of top-level AST nodes.
+ */
+using Statement = std::variant<VarDef, Rule, Include>;
+
+/**
+ * @brief Parses one Makefile into its statements in source order, keeping
+ * `include` directives for the caller to expand (see `makefile_loader`).
+ */
+std::vector<Statement> parseStatements(
+    Generator<std::vector<lexer::Token>> lines);
+
+/**
+ * @throw ParserException if the input contains an `include` directive.
+ */
+std::pair<std::vector<VarDef>, std::vector<Rule>> parse(
+    const std::vector<lexer::Token>& tokens);
+
+/**
+ * @brief Streaming variant of `parse`, consumes the output of
+ * `lexer::lexLines` and only keeps the tokens of the current statement alive.
+ */
 std::pair<std::vector<VarDef>, std::vector<Rule>> parse(
-    std::vector<std::shared_ptr<lexer::Token>> tokens);
+    Generator<std::vector<lexer::Token>> lines);
 }  // namespace parser
\ No newline at end of file
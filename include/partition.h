@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "rule-dep.h"
+
+namespace partition {
+
+/**
+ * @brief Goals of every shard, and the shard running each rule.
+ */
+struct Partition {
+    static constexpr uint32_t NO_SHARD = UINT32_MAX;
+
+    std::vector<std::vector<rule_dep::NodeId>> goals;
+    // Indexed like the rules, `NO_SHARD` for rules without recipe or not
+    // needed by any goal. Other shards needing a rule wait for its owner.
+    std::vector<uint32_t> ownerOf;
+};
+
+/**
+ * @brief Splits the work of building `goals` into `numShards` shards.
+ *
+ * Goals whose rule has no recipe (e.g. `all`) do no work themselves, so they
+ * are replaced by their prerequisites first. The remaining goals are assigned
+ * greedily, largest prerequisite closure first, to the shard where the work
+ * it adds (the rules in its closure no shard owns yet) plus its cross-shard
+ * edges (the rules owned by other shards it directly needs) plus the shard's
+ * current load is smallest. The shard then owns the added rules. Goals
+ * sharing prerequisites thus tend to land in the same shard, which keeps
+ * cross-shard waits low while balancing load.
+ *
+ * The closure of an owned rule is owned as a whole, so the walk assigning a
+ * goal stops at owned rules: assigning every goal takes O(nodes + edges)
+ * time on top of sizing the closures, and O(nodes + rules) memory.
+ *
+ * The result only depends on the graph and the arguments, so independent
+ * processes agree on it. Building every shard builds exactly what building
+ * `goals` would, each rule in exactly one shard.
+ */
+Partition partitionGoals(
+    const rule_dep::Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules,
+    std::span<const rule_dep::NodeId> goals, size_t numShards);
+}  // namespace partition
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "exception.h"
+#include "thread-pool.h"
+
+namespace rule_dep {
+
+class RuleDepException : public RuntimeException {
+   public:
+    RuleDepException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+using NodeId = uint32_t;
+
+/**
+ * @brief Dependency graph over files: one node per target or prerequisite,
+ * with an edge from each target to each of its prerequisites.
+ *
+ * Both directions are stored in CSR form (an offset array into one flat edge
+ * array), so walking either direction touches contiguous memory.
+ */
+class Graph {
+   public:
+    /**
+     * @brief Prerequisites of a target listed by several rules are merged.
+     * The recipe is taken from the last rule that has one.
+     */
+    explicit Graph(
+        const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules);
+    Graph(Graph&&) = default;
+    Graph& operator=(Graph&&) = default;
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    size_t numNodes() const { return names.size(); }
+    const std::string& name(NodeId node) const { return *names[node]; }
+    std::optional<NodeId> find(std::string_view name) const;
+
+    /**
+     * @brief Index in the constructor's `rules` of the rule producing `node`,
+     * nothing for source files.
+     */
+    std::optional<size_t> ruleOf(NodeId node) const;
+
+    std::span<const NodeId> prereqs(NodeId node) const {
+        return {prereqEdges.data() + prereqOffsets[node],
+                prereqEdges.data() + prereqOffsets[node + 1]};
+    }
+    std::span<const NodeId> dependents(NodeId node) const {
+        return {dependentEdges.data() + dependentOffsets[node],
+                dependentEdges.data() + dependentOffsets[node + 1]};
+    }
+
+   private:
+    static constexpr size_t NO_RULE = SIZE_MAX;
+
+    // Names point into the keys of `ids`, which are stable.
+    std::unordered_map<std::string, NodeId> ids;
+    std::vector<const std::string*> names;
+    std::vector<size_t> producers;
+    std::vector<size_t> prereqOffsets;
+    std::vector<NodeId> prereqEdges;
+    std::vector<size_t> dependentOffsets;
+    std::vector<NodeId> dependentEdges;
+};
+
+/**
+ * @brief Strongly connected components in reverse topological order: every
+ * component comes after all components it has an edge into (its
+ * prerequisites).
+ *
+ * Iterative Tarjan, linear in the size of the graph and independent of the
+ * depth of dependency chains.
+ */
+std::vector<std::vector<NodeId>> stronglyConnectedComponents(
+    const Graph& graph);
+
+/**
+ * @brief Topological levels: level 0 holds nodes without prerequisites, and
+ * every other node is one level above its highest prerequisite. Nodes of one
+ * level don't depend on each other.
+ */
+struct Levelization {
+    std::vector<uint32_t> levelOf;
+    std::vector<std::vector<NodeId>> levels;
+};
+
+/**
+ * @brief Levelizes the graph built from `rules`.
+ *
+ * @throw RuleDepException listing one cycle per cyclic strongly connected
+ * component, each as the full target path with the Makefile line of every
+ * target's rule. A component containing several cycles is reported through
+ * just one of them, so not every cycle is listed.
+ */
+Levelization levelize(
+    const Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules);
+
+/**
+ * @brief All nodes that transitively depend on any of `seeds`, `seeds`
+ * included, in ascending order.
+ *
+ * Level-synchronous BFS over the reverse edges; large frontiers are split
+ * across `pool`.
+ */
+std::vector<NodeId> reverseReachable(const Graph& graph,
+                                     std::span<const NodeId> seeds,
+                                     thread_pool::ThreadPool& pool);
+}  // namespace rule_dep
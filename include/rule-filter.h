@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "exception.h"
+#include "rule-dep.h"
+
+namespace rule_filter {
+
+class RuleFilterException : public RuntimeException {
+   public:
+    RuleFilterException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Modification times of the files of graph nodes.
+ *
+ * A node's mtime is only kept between lookups while the node is watched,
+ * i.e. while the owner (a build server) is notified of every change to its
+ * file and calls `invalidate`. Other nodes are stat'ed on every lookup.
+ */
+class MtimeTable {
+   public:
+    explicit MtimeTable(size_t numNodes) : entries(numNodes) {}
+
+    /**
+     * @brief Nothing if the file doesn't exist.
+     */
+    std::optional<std::filesystem::file_time_type> get(
+        const rule_dep::Graph& graph, rule_dep::NodeId node);
+
+    void invalidate(rule_dep::NodeId node) { entries[node].known = false; }
+
+    /**
+     * @brief Starts or stops keeping the mtime of `node`, either way the
+     * next lookup stats its file.
+     */
+    void setWatched(rule_dep::NodeId node, bool watched) {
+        entries[node] = Entry{.watched = watched};
+    }
+
+    /**
+     * @brief Number of files stat'ed so far.
+     */
+    uint64_t statCalls() const { return numStatCalls; }
+
+   private:
+    struct Entry {
+        std::optional<std::filesystem::file_time_type> mtime;
+        bool known = false;
+        bool watched = false;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t numStatCalls = 0;
+};
+
+/**
+ * @brief Marks the nodes whose rules must run to bring `goals` up to date.
+ *
+ * As in make, a target is out of date if its file doesn't exist, if a
+ * prerequisite is newer, or if a prerequisite is out of date itself. Only
+ * the prerequisite closure of `goals` is examined (and stat'ed), level by
+ * level so that prerequisites are always decided first.
+ *
+ * @throw RuleFilterException if a needed file neither exists nor has a rule.
+ */
+std::vector<bool> filter(const rule_dep::Graph& graph,
+                         const rule_dep::Levelization& levelization,
+                         std::span<const rule_dep::NodeId> goals);
+
+/**
+ * @brief Same as above, taking mtimes from (and recording them in) `mtimes`.
+ */
+std::vector<bool> filter(const rule_dep::Graph& graph,
+                         const rule_dep::Levelization& levelization,
+                         std::span<const rule_dep::NodeId> goals,
+                         MtimeTable& mtimes);
+}  // namespace rule_filter
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "action-cache.h"
+#include "auto-var-replacement.h"
+#include "exception.h"
+#include "rule-dep.h"
+#include "thread-pool.h"
+
+namespace scheduler {
+
+class SchedulerException : public RuntimeException {
+   public:
+    SchedulerException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Environment variable set for every recipe, so that a TinyMake run by
+ * a recipe builds in-process instead of forwarding to a build server that may
+ * be busy running that very recipe.
+ */
+inline constexpr const char* IN_RECIPE_VARIABLE = "TINYMAKE_NO_FORWARD";
+
+/**
+ * @brief Runs the rules producing the nodes marked in `outOfDate` on `pool`,
+ * at most `maxJobs` at a time.
+ *
+ * A rule is submitted as soon as every rule producing one of its out-of-date
+ * prerequisites has finished. Each recipe line runs in its own `sh`, with
+ * `IN_RECIPE_VARIABLE` set, and the line is written to `out` together with
+ * its output once it completes. With
+ * a `cache`, rules whose action is cached are restored instead of run, and
+ * the outputs of the others are stored.
+ *
+ * Ready rules marked in `batchable` (indexed like `rules`) that share their
+ * recipe template are run together by one `batch::combinedCommand` of at
+ * most `maxBatchSize` rules, and succeed or fail together.
+ *
+ * Rules marked in `awaited` (indexed like `rules`) are built by another
+ * process, e.g. another shard. Instead of running them, their targets are
+ * polled until they exist and are no older than the rule's prerequisites.
+ * Polling happens between scheduling steps, so waiting holds no worker.
+ *
+ * @return Number of rules run or restored.
+ * @throw SchedulerException if a recipe fails or an awaited rule isn't
+ * built within `awaitTimeout`; no new rule is started after a failure, but
+ * the ones already running are waited for.
+ */
+size_t execute(
+    const rule_dep::Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules,
+    const std::vector<bool>& outOfDate, thread_pool::ThreadPool& pool,
+    size_t maxJobs, const action_cache::ActionCache* cache, std::ostream& out,
+    const std::vector<bool>& batchable = {}, size_t maxBatchSize = 1,
+    const std::vector<bool>& awaited = {},
+    std::chrono::seconds awaitTimeout = std::chrono::seconds(600));
+}  // namespace scheduler
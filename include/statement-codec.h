@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "exception.h"
+#include "parser.h"
+
+namespace statement_codec {
+
+class CodecException : public RuntimeException {
+   public:
+    CodecException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Serializes parsed statements, keeping every token's line number and
+ * `joined` flag, so that `decode` gives back the exact parser output.
+ */
+std::string encode(const std::vector<parser::Statement>& statements);
+
+/**
+ * @throw CodecException if `data` was not produced by `encode`.
+ */
+std::vector<parser::Statement> decode(std::string_view data);
+}  // namespace statement_codec
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace stats {
+
+/**
+ * @brief Counts heap allocations made through global `operator new` (by any
+ * thread) while alive if `enable` is set, and restores the previous setting
+ * when destroyed. Counting is off by default and costs one relaxed atomic
+ * load per allocation while off.
+ */
+class AllocationCounting {
+   public:
+    explicit AllocationCounting(bool enable);
+    ~AllocationCounting();
+    AllocationCounting(const AllocationCounting&) = delete;
+    AllocationCounting& operator=(const AllocationCounting&) = delete;
+
+   private:
+    bool previous;
+};
+
+struct AllocationCounters {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t deallocations = 0;
+};
+
+AllocationCounters allocationCounters();
+
+/**
+ * @brief Peak resident set size of this process so far, in KiB. It covers
+ * the whole process, e.g. every request a build server has served.
+ */
+uint64_t peakRssKib();
+
+/**
+ * @brief Per-pass resource accounting of one run, serializable as JSON.
+ */
+class Report {
+   public:
+    struct Pass {
+        std::string name;
+        double seconds = 0;
+        AllocationCounters allocations;
+        // What the pass processed, e.g. 1000 "tokens", for a throughput.
+        uint64_t items = 0;
+        std::string itemUnit;
+    };
+
+    /**
+     * @brief Measures the pass named `name` from construction to
+     * destruction.
+     */
+    class Scope {
+       public:
+        Scope(Report& report_, const std::string& name);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        void setItems(uint64_t items, const std::string& unit);
+
+       private:
+        Report& report;
+        Pass pass;
+        std::chrono::steady_clock::time_point start;
+        AllocationCounters startCounters;
+    };
+
+    std::vector<Pass> passes;
+    // Fraction of the execute pass' worker time spent running tasks.
+    double workerUtilization = 0;
+    size_t workers = 0;
+
+    std::string toJson() const;
+};
+}  // namespace stats
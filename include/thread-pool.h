@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "exception.h"
+
+namespace thread_pool {
+
+class ThreadPoolException : public RuntimeException {
+   public:
+    ThreadPoolException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Fixed-size pool of worker threads executing tasks in FIFO order.
+ *
+ * The destructor finishes all queued tasks before joining the workers.
+ */
+class ThreadPool {
+   public:
+    /**
+     * @param numThreads Number of workers, at least one is always created.
+     */
+    explicit ThreadPool(size_t numThreads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    /**
+     * @brief Total time workers spent running tasks since construction.
+     */
+    std::chrono::nanoseconds busyTime() const {
+        return std::chrono::nanoseconds(busyNanos.load());
+    }
+
+    /**
+     * @brief Queues `f` for execution, exceptions thrown by `f` are rethrown
+     * by `get()` of the returned future.
+     */
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& f) {
+        using Result = std::invoke_result_t<F>;
+        auto task =
+            std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+        std::future<Result> future = task->get_future();
+        {
+            std::lock_guard lock(mutex);
+            if (stopping) {
+                throw ThreadPoolException({"submit on a stopped thread pool"});
+            }
+            tasks.emplace([task] { (*task)(); });
+        }
+        cv.notify_one();
+        return future;
+    }
+
+    /**
+     * @brief Calls `f(i)` for every `i` in [0, n), split into contiguous
+     * chunks across the workers, and waits for all of them. The first
+     * exception thrown by `f` is rethrown once every chunk has finished.
+     *
+     * Must not be called from a task running on this pool.
+     */
+    template <typename F>
+    void parallelFor(size_t n, F&& f) {
+        if (n == 0) {
+            return;
+        }
+        if (size() == 1) {
+            for (size_t i = 0; i < n; i++) {
+                f(i);
+            }
+            return;
+        }
+        // A few chunks per worker, to even out uneven per-index costs.
+        size_t numChunks = std::min(n, size() * 4);
+        size_t chunkSize = (n + numChunks - 1) / numChunks;
+        std::vector<std::future<void>> chunks;
+        for (size_t begin = 0; begin < n; begin += chunkSize) {
+            size_t end = std::min(n, begin + chunkSize);
+            chunks.emplace_back(submit([&f, begin, end] {
+                for (size_t i = begin; i < end; i++) {
+                    f(i);
+                }
+            }));
+        }
+        std::exception_ptr exception;
+        for (auto& c : chunks) {
+            try {
+                c.get();
+            } catch (...) {
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+            }
+        }
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+   private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::atomic<int64_t> busyNanos = 0;
+
+    void workerLoop();
+};
+}  // namespace thread_pool
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -10,18 +14,21 @@
 namespace var_replacement {
 
 struct String final {
-    std::vector<std::variant<std::string, lexer::AutoVar>> segments;
+    using Segment = std::variant<std::string, lexer::AutoVar, lexer::Dollar>;
 
-    explicit String(
-        const std::vector<std::variant<std::string, lexer::AutoVar>>& segments_)
+    std::vector<Segment> segments;
+
+    explicit String(const std::vector<Segment>& segments_)
         : segments(segments_) {}
     std::string toString() const {
         std::string result("(String ");
         for (const auto& seg : segments) {
             if (seg.index() == 0) {
                 result += std::get<std::string>(seg);
-            } else {
+            } else if (seg.index() == 1) {
                 result += std::get<lexer::AutoVar>(seg).toString();
+            } else {
+                result += std::get<lexer::Dollar>(seg).toString();
             }
         }
         result += ')';
@@ -29,17 +36,24 @@ struct String final {
     }
 };
 
+/**
+ * @brief Rule with every variable expanded. Automatic variables are kept, and
+ * each recipe is one line of words.
+ */
 struct Rule final {
+    using Part = std::variant<std::string, lexer::AutoVar, String>;
+    // Parts written without whitespace in between, e.g. `$(DIR)/$@`.
+    using Word = std::vector<Part>;
+    using Recipe = std::vector<Word>;
+
     std::vector<std::string> targets;
     std::vector<std::string> prereqs;
-    std::vector<std::variant<std::string, lexer::AutoVar, String>> recipes;
+    std::vector<Recipe> recipes;
     size_t lineno;
 
     Rule(const std::vector<std::string>& targets_,
          const std::vector<std::string>& prereqs_,
-         const std::vector<std::variant<std::string, lexer::AutoVar, String>>&
-             recipes_,
-         size_t lineno_)
+         const std::vector<Recipe>& recipes_, size_t lineno_)
         : targets(targets_),
           prereqs(prereqs_),
           recipes(recipes_),
@@ -47,11 +61,86 @@ struct Rule final {
     std::string toString() const {
         std::string result;
         result += "(Rule:";
-
-        result += ")";
+        result += "(Targets:";
+        for (const auto& t : targets) {
+            result += ' ' + t;
+        }
+        result += ")(Prerequisites:";
+        for (const auto& p : prereqs) {
+            result += ' ' + p;
+        }
+        result += ")(Recipes:";
+        for (const auto& r : recipes) {
+            result += " (Recipe:";
+            for (const auto& w : r) {
+                result += ' ';
+                for (const auto& part : w) {
+                    if (std::holds_alternative<std::string>(part)) {
+                        result += std::get<std::string>(part);
+                    } else if (std::holds_alternative<lexer::AutoVar>(part)) {
+                        result += std::get<lexer::AutoVar>(part).toString();
+                    } else {
+                        result += std::get<String>(part).toString();
+                    }
+                }
+            }
+            result += ")";
+        }
+        result += "))";
         return result;
     };
 };
 
-std::shared_ptr<Rule> replace(const std::shared_ptr<parser::Rule>& rule);
-}  // namespace var_replacement
\ No newline at end of file
+using Variables = std::unordered_map<std::string, std::vector<std::string>>;
+
+/**
+ * @brief Collects the words tokens expand to. The expansion of a token
+ * `joined` to the previous one continues the last word instead of starting a
+ * new one, unless everything since the last separator expanded to nothing.
+ *
+ * @tparam WordT `std::string`, or `Rule::Word` for recipes.
+ */
+template <typename WordT>
+class WordBuilder {
+   public:
+    /**
+     * @brief Starts the expansion of the next token.
+     */
+    void beginToken(bool joined) {
+        continues = open && joined;
+        open = continues;
+    }
+
+    /**
+     * @brief Adds the next word of the current token's expansion.
+     */
+    template <typename PartT>
+    void add(PartT&& part) {
+        if (!continues) {
+            words.emplace_back();
+        }
+        if constexpr (std::is_same_v<WordT, std::string>) {
+            words.back() += std::forward<PartT>(part);
+        } else {
+            words.back().emplace_back(std::forward<PartT>(part));
+        }
+        continues = false;
+        open = true;
+    }
+
+    std::vector<WordT> take() { return std::move(words); }
+
+   private:
+    std::vector<WordT> words;
+    // Whether a joined token continues `words.back()`.
+    bool open = false;
+    // Whether the current token's first word continues `words.back()`.
+    bool continues = false;
+};
+
+/**
+ * @param variables Output of `var_resolution::resolveVariables`, only read.
+ */
+std::shared_ptr<Rule> replace(const std::shared_ptr<parser::Rule>& rule,
+                              const Variables& variables);
+}  // namespace var_replacement
@@ -4,11 +4,26 @@
 #include <unordered_map>
 #include <vector>
 
+#include "exception.h"
 #include "parser.h"
 
 namespace var_resolution {
+
+class VarResolutionException : public RuntimeException {
+   public:
+    VarResolutionException(const std::vector<std::string>& whatArgs)
+        : RuntimeException(whatArgs) {}
+};
+
+/**
+ * @brief Expands every variable to its list of words.
+ *
+ * Variables are recursively expanded like `=` in make: the last definition
+ * of a variable wins, and it may reference variables defined after it.
+ * Undefined variables expand to nothing.
+ *
+ * @throw VarResolutionException if a variable references itself.
+ */
 std::unordered_map<std::string, std::vector<std::string>> resolveVariables(
-    const std::vector<parser::VarDef>& varAssignments) {
-    return {};
-}
-}  // namespace var_resolution
\ No newline at end of file
+    const std::vector<parser::VarDef>& varAssignments);
+}  // namespace var_resolution
@@ -0,0 +1,185 @@
+#include "action-cache.h"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "digest.h"
+
+namespace action_cache {
+
+namespace fs = std::filesystem;
+
+static fs::path tempPathFor(const fs::path& path) {
+    static std::atomic<size_t> counter = 0;
+    return path.string() + ".tmp." + std::to_string(::getpid()) + "." +
+           std::to_string(counter++);
+}
+
+static bool reflink(const fs::path& from, const fs::path& to) {
+    int src = ::open(from.c_str(), O_RDONLY);
+    if (src < 0) {
+        return false;
+    }
+    int dst = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (dst < 0) {
+        ::close(src);
+        return false;
+    }
+    bool successful = ::ioctl(dst, FICLONE, src) == 0;
+    ::close(src);
+    ::close(dst);
+    if (!successful) {
+        fs::remove(to);
+    }
+    return successful;
+}
+
+/**
+ * @brief Copies `blob` next to `target` (as a reflink where supported) and
+ * returns the path of the copy. The copy is a writable file of its own, so
+ * recipes writing to the target later can't modify the cache.
+ */
+static fs::path stageCopy(const fs::path& blob, const fs::path& target) {
+    if (target.has_parent_path()) {
+        fs::create_directories(target.parent_path());
+    }
+    fs::path tmp = tempPathFor(target);
+    if (!reflink(blob, tmp)) {
+        fs::copy_file(blob, tmp);
+        fs::permissions(tmp, fs::perms::owner_write, fs::perm_options::add);
+    }
+    return tmp;
+}
+
+ActionCache::ActionCache(const fs::path& cacheDir_) : cacheDir(cacheDir_) {
+    fs::create_directories(cacheDir / "blobs");
+    fs::create_directories(cacheDir / "actions");
+}
+
+fs::path ActionCache::blobPath(const std::string& contentHash) const {
+    return cacheDir / "blobs" / contentHash;
+}
+
+fs::path ActionCache::manifestPath(const std::string& key) const {
+    return cacheDir / "actions" / key;
+}
+
+std::string ActionCache::actionKey(
+    const auto_var_replacement::Rule& rule) const {
+    digest::Hasher hasher;
+    hasher.updateField("targets");
+    for (const auto& t : rule.targets) {
+        hasher.updateField(t);
+    }
+    hasher.updateField("recipes");
+    for (const auto& r : rule.recipes) {
+        hasher.updateField(r);
+    }
+    hasher.updateField("prereqs");
+    for (const auto& p : rule.prereqs) {
+        hasher.updateField(p);
+        if (fs::is_regular_file(p)) {
+            hasher.updateField(digest::hashFile(p));
+        } else {
+            hasher.updateField("");
+        }
+    }
+    return hasher.hexDigest();
+}
+
+std::optional<std::vector<std::pair<std::string, std::string>>>
+ActionCache::readManifest(const std::string& key) const {
+    std::ifstream fin(manifestPath(key));
+    if (!fin.is_open()) {
+        return {};
+    }
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::string line;
+    while (std::getline(fin, line)) {
+        size_t sep = line.find(' ');
+        if (sep == std::string::npos) {
+            throw ActionCacheException(
+                {"corrupted action cache manifest:",
+                 manifestPath(key).string()});
+        }
+        entries.emplace_back(line.substr(0, sep), line.substr(sep + 1));
+    }
+    return entries;
+}
+
+bool ActionCache::restore(const std::string& key) const {
+    auto entries = readManifest(key);
+    if (!entries.has_value()) {
+        return false;
+    }
+    for (const auto& [contentHash, target] : entries.value()) {
+        if (!fs::is_regular_file(blobPath(contentHash))) {
+            return false;
+        }
+    }
+    // Stage and verify every target before replacing any of them, so that a
+    // corrupted blob is a cache miss that leaves the workspace untouched.
+    std::vector<std::pair<fs::path, std::string>> staged;
+    for (const auto& [contentHash, target] : entries.value()) {
+        fs::path tmp = stageCopy(blobPath(contentHash), target);
+        staged.emplace_back(tmp, target);
+        if (digest::hashFile(tmp) != contentHash) {
+            for (const auto& [path, _] : staged) {
+                fs::remove(path);
+            }
+            std::error_code ec;
+            fs::remove(blobPath(contentHash), ec);
+            return false;
+        }
+    }
+    for (const auto& [tmp, target] : staged) {
+        fs::rename(tmp, target);
+        fs::last_write_time(target, fs::file_time_type::clock::now());
+    }
+    return true;
+}
+
+void ActionCache::store(const std::string& key,
+                        const std::vector<std::string>& targets) const {
+    for (const auto& t : targets) {
+        if (!fs::is_regular_file(t)) {
+            return;
+        }
+    }
+    std::string manifest;
+    for (const auto& t : targets) {
+        std::string contentHash = digest::hashFile(t);
+        fs::path blob = blobPath(contentHash);
+        if (!fs::exists(blob)) {
+            fs::path tmp = tempPathFor(blob);
+            fs::copy_file(t, tmp);
+            fs::permissions(tmp,
+                            fs::perms::owner_read | fs::perms::group_read |
+                                fs::perms::others_read,
+                            fs::perm_options::replace);
+            fs::rename(tmp, blob);
+        }
+        manifest += contentHash + ' ' + t + '\n';
+    }
+    fs::path tmp = tempPathFor(manifestPath(key));
+    {
+        std::ofstream fout(tmp);
+        if (!fout.is_open()) {
+            throw ActionCacheException(
+                {"can't write action cache manifest:", tmp.string()});
+        }
+        fout << manifest;
+    }
+    fs::rename(tmp, manifestPath(key));
+}
+}  // namespace action_cache
@@ -0,0 +1,118 @@
+#include "auto-var-replacement.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "lexer.h"
+#include "var-replacement.h"
+
+namespace auto_var_replacement {
+
+static std::string expandAutoVar(const lexer::AutoVar& autoVar,
+                                 const var_replacement::Rule& rule) {
+    switch (autoVar.type) {
+        case lexer::AutoVar::DOLLAR_AT:
+            return rule.targets.empty() ? "" : rule.targets.front();
+        case lexer::AutoVar::DOLLAR_LT:
+            return rule.prereqs.empty() ? "" : rule.prereqs.front();
+        case lexer::AutoVar::DOLLAR_SUP: {
+            std::string result;
+            std::unordered_set<std::string> seen;
+            for (const auto& p : rule.prereqs) {
+                if (seen.insert(p).second) {
+                    if (!result.empty()) {
+                        result += ' ';
+                    }
+                    result += p;
+                }
+            }
+            return result;
+        }
+    }
+    throw lexer::LexerException({"unreachable"});
+}
+
+/**
+ * @brief Quotes `str` for the shell as one word. Only a `$` written as `$$`
+ * is left for the shell to expand.
+ */
+static std::string quote(const var_replacement::String& str,
+                         const var_replacement::Rule& rule) {
+    std::string result("\"");
+    auto escape = [&result](const std::string& content) {
+        for (char c : content) {
+            if (c == '"' || c == '\\' || c == '$' || c == '`') {
+                result += '\\';
+            }
+            result += c;
+        }
+    };
+    for (const auto& seg : str.segments) {
+        if (std::holds_alternative<std::string>(seg)) {
+            escape(std::get<std::string>(seg));
+        } else if (std::holds_alternative<lexer::AutoVar>(seg)) {
+            escape(expandAutoVar(std::get<lexer::AutoVar>(seg), rule));
+        } else {
+            result += '$';
+        }
+    }
+    result += '"';
+    return result;
+}
+
+std::shared_ptr<Rule> replace(
+    const std::shared_ptr<var_replacement::Rule>& rule) {
+    std::vector<std::string> recipes;
+    std::string recipeTemplate;
+    size_t argsOffset = std::string::npos;
+    for (const auto& line : rule->recipes) {
+        std::string recipe;
+        recipeTemplate.clear();
+        argsOffset = std::string::npos;
+        for (const auto& word : line) {
+            if (!recipe.empty()) {
+                recipe += ' ';
+                recipeTemplate += ' ';
+            }
+            size_t wordOffset = recipe.size();
+            bool usesAutoVar = false;
+            for (const auto& part : word) {
+                if (std::holds_alternative<std::string>(part)) {
+                    recipe += std::get<std::string>(part);
+                    recipeTemplate +=
+                        "(Word " + std::get<std::string>(part) + ")";
+                } else if (std::holds_alternative<lexer::AutoVar>(part)) {
+                    const auto& autoVar = std::get<lexer::AutoVar>(part);
+                    recipe += expandAutoVar(autoVar, *rule);
+                    recipeTemplate += autoVar.toString();
+                    usesAutoVar = true;
+                } else {
+                    const auto& str = std::get<var_replacement::String>(part);
+                    for (const auto& seg : str.segments) {
+                        if (std::holds_alternative<lexer::AutoVar>(seg)) {
+                            usesAutoVar = true;
+                        }
+                    }
+                    recipe += quote(str, *rule);
+                    recipeTemplate += str.toString();
+                }
+            }
+            if (usesAutoVar && argsOffset == std::string::npos) {
+                argsOffset = wordOffset;
+            }
+        }
+        recipes.emplace_back(std::move(recipe));
+    }
+    auto result = std::make_shared<Rule>(rule->targets, rule->prereqs,
+                                         recipes, rule->lineno);
+    if (recipes.size() == 1 && argsOffset != std::string::npos) {
+        result->recipeTemplate = std::move(recipeTemplate);
+        result->argsOffset = argsOffset;
+    }
+    return result;
+}
+}  // namespace auto_var_replacement
@@ -0,0 +1,58 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace batch {
+
+std::vector<bool> takeBatchable(
+    std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules) {
+    std::unordered_set<std::string> listed;
+    std::erase_if(rules, [&listed](const auto& rule) {
+        if (std::find(rule->targets.begin(), rule->targets.end(),
+                      SPECIAL_TARGET) == rule->targets.end()) {
+            return false;
+        }
+        listed.insert(rule->prereqs.begin(), rule->prereqs.end());
+        return true;
+    });
+
+    std::vector<bool> batchable(rules.size(), false);
+    if (listed.empty()) {
+        return batchable;
+    }
+    for (size_t i = 0; i < rules.size(); i++) {
+        for (const auto& t : rules[i]->targets) {
+            if (!listed.contains(t)) {
+                continue;
+            }
+            if (rules[i]->recipeTemplate.empty()) {
+                throw BatchException(
+                    {"target", t, "at line", std::to_string(rules[i]->lineno),
+                     "is listed in", std::string(SPECIAL_TARGET),
+                     "but has no single-line recipe using automatic "
+                     "variables"});
+            }
+            batchable[i] = true;
+        }
+    }
+    return batchable;
+}
+
+std::string combinedCommand(
+    const std::vector<const auto_var_replacement::Rule*>& rules) {
+    const auto& first = *rules.front();
+    std::string command = first.recipes.front().substr(0, first.argsOffset);
+    for (size_t i = 0; i < rules.size(); i++) {
+        if (i > 0) {
+            command += ' ';
+        }
+        command += rules[i]->recipes.front().substr(rules[i]->argsOffset);
+    }
+    return command;
+}
+}  // namespace batch
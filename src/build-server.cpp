@@ -0,0 +1,286 @@
+#include "build-server.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "driver.h"
+#include "scheduler.h"
+
+namespace build_server {
+
+namespace fs = std::filesystem;
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) { stopRequested = 1; }
+
+static sockaddr_un socketAddress(const fs::path& socketPath) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    const std::string& path = socketPath.native();
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw BuildServerException({"socket path too long:", path});
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+static std::string readAll(int fd) {
+    std::string result;
+    std::array<char, 1 << 16> buffer;
+    while (true) {
+        ssize_t n = ::read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return result;
+        }
+        result.append(buffer.data(), n);
+    }
+}
+
+static bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        data = data.substr(n);
+    }
+    return true;
+}
+
+/**
+ * @brief inotify watches on the directories of the session's files.
+ */
+class Watcher {
+   public:
+    Watcher() : fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+        if (fd < 0) {
+            throw BuildServerException(
+                {"inotify_init1 failed:", std::strerror(errno)});
+        }
+    }
+    ~Watcher() { ::close(fd); }
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    int fileDescriptor() const { return fd; }
+
+    /**
+     * @brief Starts watching every directory of `session` not watched yet.
+     */
+    void watchDirectories(driver::Session& session) {
+        for (const auto& dir : session.directories()) {
+            if (watchedDirs.contains(dir.string())) {
+                continue;
+            }
+            int wd = ::inotify_add_watch(
+                fd, dir.c_str(),
+                IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE |
+                    IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+            if (wd >= 0) {
+                dirs.emplace(wd, dir);
+                watchedDirs.insert(dir.string());
+                session.setWatched(dir, true);
+            }
+        }
+    }
+
+    /**
+     * @brief Calls `session.invalidate` for every file changed since the last
+     * call, without blocking.
+     */
+    void drain(driver::Session& session) {
+        alignas(inotify_event) std::array<char, 1 << 16> buffer;
+        while (true) {
+            ssize_t n = ::read(fd, buffer.data(), buffer.size());
+            if (n <= 0) {
+                return;
+            }
+            for (ssize_t offset = 0; offset < n;) {
+                const auto* event =
+                    reinterpret_cast<const inotify_event*>(&buffer[offset]);
+                if (event->mask & IN_Q_OVERFLOW) {
+                    // Changes were lost, nothing cached can be trusted.
+                    session.buildState.reset();
+                } else if ((event->mask & IN_IGNORED) &&
+                           dirs.contains(event->wd)) {
+                    session.setWatched(dirs.at(event->wd), false);
+                    watchedDirs.erase(dirs.at(event->wd).string());
+                    dirs.erase(event->wd);
+                } else if (event->len > 0 && dirs.contains(event->wd)) {
+                    session.invalidate(dirs.at(event->wd) / event->name);
+                }
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+
+   private:
+    int fd;
+    std::unordered_map<int, fs::path> dirs;
+    std::unordered_set<std::string> watchedDirs;
+};
+
+static void handleClient(int client, driver::Session& session) {
+    std::string request = readAll(client);
+    std::vector<std::string> args;
+    for (size_t begin = 0; begin < request.size();) {
+        size_t end = request.find('\0', begin);
+        if (end == std::string::npos) {
+            end = request.size();
+        }
+        args.emplace_back(request.substr(begin, end - begin));
+        begin = end + 1;
+    }
+
+    std::ostringstream out;
+    std::ostringstream err;
+    char status = 0;
+    try {
+        driver::Options options = driver::parseOptions(args);
+        if (options.concurrency > session.pool.size()) {
+            err << "TinyMake: -t " << options.concurrency
+                << " capped to the build server's " << session.pool.size()
+                << " threads" << std::endl;
+        }
+        driver::run(options, session, out);
+    } catch (const std::exception& e) {
+        driver::reportError(e, err);
+        status = 1;
+    }
+    std::string response(1, status);
+    response += std::to_string(err.str().size());
+    response += '\n';
+    response += err.str();
+    response += out.str();
+    writeAll(client, response);
+}
+
+Server::Server(size_t concurrency, const fs::path& socketPath_)
+    : session(concurrency),
+      socketPath(socketPath_),
+      watcher(std::make_unique<Watcher>()),
+      listener(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+    if (listener < 0) {
+        throw BuildServerException({"socket failed:", std::strerror(errno)});
+    }
+    sockaddr_un addr = socketAddress(socketPath);
+    ::unlink(addr.sun_path);  // Stale socket of a server that was killed.
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) <
+            0 ||
+        ::listen(listener, SOMAXCONN) < 0) {
+        ::close(listener);
+        throw BuildServerException(
+            {"can't listen on", socketPath.string() + ":",
+             std::strerror(errno)});
+    }
+}
+
+Server::~Server() {
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+}
+
+bool Server::serveNext() {
+    while (!stopRequested) {
+        std::array<pollfd, 2> fds{{{listener, POLLIN, 0},
+                                   {watcher->fileDescriptor(), POLLIN, 0}}};
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            continue;  // EINTR, `stopRequested` is checked by the loop.
+        }
+        if (fds[1].revents & POLLIN) {
+            watcher->drain(session);
+        }
+        if (fds[0].revents & POLLIN) {
+            int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                continue;
+            }
+            // Don't serve a request with changes that are already queued.
+            watcher->drain(session);
+            handleClient(client, session);
+            ::close(client);
+            watcher->watchDirectories(session);
+            return true;
+        }
+    }
+    return false;
+}
+
+void serve(size_t concurrency, const fs::path& socketPath) {
+    Server server(concurrency, socketPath);
+
+    struct sigaction action {};
+    action.sa_handler = requestStop;
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+
+    while (server.serveNext()) {
+    }
+}
+
+std::optional<int> forward(const fs::path& socketPath,
+                           const std::vector<std::string>& args,
+                           std::ostream& out, std::ostream& err) {
+    if (std::getenv(scheduler::IN_RECIPE_VARIABLE) != nullptr ||
+        !fs::exists(socketPath)) {
+        return {};
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return {};
+    }
+    sockaddr_un addr = socketAddress(socketPath);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        ::close(fd);
+        return {};
+    }
+    std::string request;
+    for (const auto& arg : args) {
+        request += arg;
+        request += '\0';
+    }
+    if (!writeAll(fd, request)) {
+        ::close(fd);
+        throw BuildServerException({"lost connection to build server"});
+    }
+    ::shutdown(fd, SHUT_WR);
+    std::string response = readAll(fd);
+    ::close(fd);
+    size_t newline = response.find('\n');
+    if (response.empty() || newline == std::string::npos) {
+        throw BuildServerException({"malformed response from build server"});
+    }
+    size_t errSize = std::stoul(response.substr(1, newline - 1));
+    out << std::string_view(response).substr(newline + 1 + errSize);
+    out.flush();
+    err << std::string_view(response).substr(newline + 1, errSize);
+    err.flush();
+    return static_cast<unsigned char>(response[0]);
+}
+}  // namespace build_server
@@ -0,0 +1,62 @@
+#include "digest.h"
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+namespace digest {
+
+static constexpr unsigned __int128 FNV_PRIME =
+    (static_cast<unsigned __int128>(1) << 88) | 0x13b;
+
+Hasher& Hasher::update(std::string_view data) {
+    for (char c : data) {
+        state ^= static_cast<unsigned char>(c);
+        state *= FNV_PRIME;
+    }
+    return *this;
+}
+
+Hasher& Hasher::updateField(std::string_view data) {
+    update(std::to_string(data.size()));
+    update(":");
+    return update(data);
+}
+
+std::string Hasher::hexDigest() const {
+    static constexpr std::string_view hexChars = "0123456789abcdef";
+    std::string result(32, '0');
+    unsigned __int128 value = state;
+    for (size_t i = 0; i < result.size(); i++) {
+        result[result.size() - 1 - i] = hexChars[value & 0xf];
+        value >>= 4;
+    }
+    return result;
+}
+
+std::string hashString(std::string_view data) {
+    return Hasher().update(data).hexDigest();
+}
+
+std::string hashFile(const std::filesystem::path& path) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        throw DigestException({"can't open file for hashing, path:",
+                               path.string()});
+    }
+    Hasher hasher;
+    std::array<char, 1 << 16> buffer;
+    while (fin) {
+        fin.read(buffer.data(), buffer.size());
+        hasher.update(std::string_view(buffer.data(), fin.gcount()));
+    }
+    if (fin.bad()) {
+        throw DigestException({"error while reading file, path:",
+                               path.string()});
+    }
+    return hasher.hexDigest();
+}
+}  // namespace digest
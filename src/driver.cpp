@@ -0,0 +1,539 @@
+#include "driver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "action-cache.h"
+#include "auto-var-replacement.h"
+#include "batch.h"
+#include "lexer.h"
+#include "makefile-loader.h"
+#include "parser.h"
+#include "partition.h"
+#include "rule-dep.h"
+#include "rule-filter.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "var-replacement.h"
+#include "var-resolution.h"
+
+namespace driver {
+
+/**
+ * @brief Parses the `i/N` argument of `--shard`, `i` is 1-based.
+ */
+static void parseShard(const std::string& arg, Options& options) {
+    size_t slash = arg.find('/');
+    size_t index = 0;
+    size_t count = 0;
+    try {
+        size_t end = 0;
+        if (slash != std::string::npos) {
+            index = std::stoul(arg.substr(0, slash), &end);
+            if (end != slash) {
+                index = 0;
+            }
+            count = std::stoul(arg.substr(slash + 1), &end);
+            if (end != arg.size() - slash - 1) {
+                count = 0;
+            }
+        }
+    } catch (const std::logic_error&) {
+        index = 0;
+    }
+    if (index == 0 || count == 0 || index > count) {
+        throw std::runtime_error(
+            "invalid shard, expected i/N with 1 <= i <= N: " + arg);
+    }
+    options.shardIndex = index - 1;
+    options.numShards = count;
+}
+
+Options parseOptions(const std::vector<std::string>& commandLineArgs) {
+    Options options;
+    for (size_t i = 0; i < commandLineArgs.size(); i++) {
+        if (commandLineArgs[i] == "-f") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("Makefile path missing");
+            } else {
+                options.makefilePath = commandLineArgs[i + 1];
+                i++;
+            }
+        } else if (commandLineArgs[i] == "-t") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("concurrency argument missing");
+            } else {
+                options.concurrency = std::stoul(commandLineArgs[i + 1]);
+                i++;
+            }
+        } else if (commandLineArgs[i] == "--affected-by") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("changed file list missing");
+            } else {
+                options.affectedBy = commandLineArgs[i + 1];
+                i++;
+            }
+        } else if (commandLineArgs[i] == "--cache-dir") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("cache directory missing");
+            } else {
+                options.cacheDir = commandLineArgs[i + 1];
+                i++;
+            }
+        } else if (commandLineArgs[i] == "--stats") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("stats output path missing");
+            } else {
+                options.statsPath = commandLineArgs[i + 1];
+                i++;
+            }
+        } else if (commandLineArgs[i] == "--batch-size") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("batch size missing");
+            } else {
+                options.batchSize = std::stoul(commandLineArgs[i + 1]);
+                i++;
+            }
+        } else if (commandLineArgs[i] == "--shard") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("shard argument missing");
+            } else {
+                parseShard(commandLineArgs[i + 1], options);
+                i++;
+            }
+        } else if (commandLineArgs[i] == "--shard-timeout") {
+            if (i + 1 == commandLineArgs.size()) {
+                throw std::runtime_error("shard timeout missing");
+            } else {
+                options.shardTimeout =
+                    std::chrono::seconds(std::stoul(commandLineArgs[i + 1]));
+                i++;
+            }
+        } else if (commandLineArgs[i] == "--dump") {
+            options.dump = true;
+        } else if (commandLineArgs[i] == "--daemon") {
+            options.daemon = true;
+        } else {
+            options.targets.emplace_back(commandLineArgs[i]);
+        }
+    }
+    return options;
+}
+
+static std::string absoluteString(const std::filesystem::path& path) {
+    return std::filesystem::absolute(path).lexically_normal().string();
+}
+
+static std::string absoluteDirOf(const std::filesystem::path& path) {
+    return std::filesystem::absolute(path).lexically_normal().parent_path();
+}
+
+void Session::invalidate(const std::filesystem::path& path) {
+    if (parseCache.invalidate(path)) {
+        buildState.reset();
+        return;
+    }
+    if (buildState == nullptr) {
+        return;
+    }
+    auto it = buildState->nodeOfPath.find(absoluteString(path));
+    if (it != buildState->nodeOfPath.end()) {
+        buildState->mtimes.invalidate(it->second);
+    }
+}
+
+std::vector<std::filesystem::path> Session::directories() {
+    std::unordered_set<std::string> dirs;
+    for (const auto& makefile : parseCache.paths()) {
+        dirs.insert(absoluteDirOf(makefile));
+    }
+    if (buildState != nullptr) {
+        indexPaths(*buildState);
+        for (const auto& [dir, nodes] : buildState->nodesInDir) {
+            dirs.insert(dir);
+        }
+    }
+    return {dirs.begin(), dirs.end()};
+}
+
+void Session::setWatched(const std::filesystem::path& dir, bool watched) {
+    std::string key = absoluteDirOf(dir / "");
+    if (watched) {
+        watchedDirs.insert(key);
+    } else {
+        watchedDirs.erase(key);
+    }
+    if (buildState == nullptr) {
+        return;
+    }
+    if (!watched) {
+        for (const auto& makefile : parseCache.paths()) {
+            if (absoluteDirOf(makefile) == key) {
+                buildState.reset();
+                return;
+            }
+        }
+    }
+    indexPaths(*buildState);
+    auto it = buildState->nodesInDir.find(key);
+    if (it != buildState->nodesInDir.end()) {
+        for (auto node : it->second) {
+            buildState->mtimes.setWatched(node, watched);
+        }
+    }
+}
+
+void Session::setBuildState(std::unique_ptr<BuildState> state) {
+    state->reusable = true;
+    for (const auto& makefile : parseCache.paths()) {
+        if (!watchedDirs.contains(absoluteDirOf(makefile))) {
+            state->reusable = false;
+        }
+    }
+    if (!watchedDirs.empty()) {
+        indexPaths(*state);
+        for (const auto& dir : watchedDirs) {
+            auto it = state->nodesInDir.find(dir);
+            if (it == state->nodesInDir.end()) {
+                continue;
+            }
+            for (auto node : it->second) {
+                state->mtimes.setWatched(node, true);
+            }
+        }
+    }
+    buildState = std::move(state);
+}
+
+void Session::indexPaths(BuildState& state) const {
+    if (!state.nodeOfPath.empty() || state.graph.numNodes() == 0) {
+        return;
+    }
+    for (rule_dep::NodeId node = 0; node < state.graph.numNodes(); node++) {
+        std::filesystem::path path = absoluteString(state.graph.name(node));
+        state.nodeOfPath.emplace(path.string(), node);
+        state.nodesInDir[path.parent_path().string()].push_back(node);
+    }
+}
+
+/**
+ * @brief Passes 4 & 5: Variable Replacement, Automatic Variable Replacement.
+ */
+static std::vector<std::shared_ptr<auto_var_replacement::Rule>> replaceRules(
+    const var_replacement::Variables& variables,
+    std::vector<parser::Rule>&& rules, thread_pool::ThreadPool& pool) {
+    // Rules are independent of each other and `variables` is only read, so
+    // each index is expanded in place without any locking.
+    std::vector<std::shared_ptr<auto_var_replacement::Rule>> expanded(
+        rules.size());
+    pool.parallelFor(rules.size(), [&](size_t i) {
+        expanded[i] = auto_var_replacement::replace(var_replacement::replace(
+            std::make_shared<parser::Rule>(std::move(rules[i])), variables));
+    });
+    return expanded;
+}
+
+/**
+ * @brief Passes 3-5, turns parsed rules into fully expanded ones.
+ */
+static std::vector<std::shared_ptr<auto_var_replacement::Rule>> expandRules(
+    const std::vector<parser::VarDef>& varDefs,
+    std::vector<parser::Rule>&& rules, thread_pool::ThreadPool& pool) {
+    // Pass 3: Variable Resolution
+    const auto variables = var_resolution::resolveVariables(varDefs);
+    return replaceRules(variables, std::move(rules), pool);
+}
+
+static void queryAffected(const Options& options, Session& session,
+                          std::ostream& out) {
+    auto [varDefs, rules] = makefile_loader::load(
+        options.makefilePath, session.pool, session.parseCache);
+    auto expanded = expandRules(varDefs, std::move(rules), session.pool);
+    batch::takeBatchable(expanded);
+    rule_dep::Graph graph(expanded);
+
+    std::ifstream fin(options.affectedBy.value());
+    if (!fin.is_open()) {
+        throw std::runtime_error("can't open changed file list, path: " +
+                                 options.affectedBy->string());
+    }
+    std::vector<rule_dep::NodeId> seeds;
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        auto node = graph.find(line);
+        if (!node.has_value()) {
+            node = graph.find(
+                std::filesystem::path(line).lexically_normal().string());
+        }
+        if (node.has_value()) {
+            seeds.emplace_back(node.value());
+        }
+    }
+
+    for (auto node : rule_dep::reverseReachable(graph, seeds, session.pool)) {
+        if (graph.ruleOf(node).has_value()) {
+            out << graph.name(node) << '\n';
+        }
+    }
+}
+
+static std::vector<rule_dep::NodeId> goalNodes(
+    const Options& options, const rule_dep::Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules) {
+    std::vector<rule_dep::NodeId> goals;
+    if (options.targets.empty()) {
+        // Like make, the default goal is the first target of the first rule.
+        if (rules.empty() || rules.front()->targets.empty()) {
+            throw std::runtime_error("No targets");
+        }
+        goals.emplace_back(graph.find(rules.front()->targets.front()).value());
+        return goals;
+    }
+    for (const auto& t : options.targets) {
+        auto node = graph.find(t);
+        if (node.has_value()) {
+            goals.emplace_back(node.value());
+        } else if (std::filesystem::exists(t)) {
+            continue;  // An existing file without rule is up to date.
+        } else {
+            throw std::runtime_error("No rule to make target " + t);
+        }
+    }
+    return goals;
+}
+
+/**
+ * @brief Passes 1-6, or the session's build state if it is still valid for
+ * `options.makefilePath`.
+ */
+static BuildState& loadBuildState(const Options& options, Session& session,
+                                  stats::Report& report) {
+    if (session.buildState != nullptr && session.buildState->reusable &&
+        session.buildState->makefilePath == options.makefilePath) {
+        return *session.buildState;
+    }
+    session.buildState.reset();
+
+    std::vector<parser::VarDef> varDefs;
+    std::vector<parser::Rule> rules;
+    {
+        // Pass 1 & 2: lexing and parsing are interleaved by the streaming
+        // loader, so they are accounted for together.
+        stats::Report::Scope scope(report, "lex_parse");
+        uint64_t tokensBefore = session.parseCache.tokensLexed();
+        std::tie(varDefs, rules) = makefile_loader::load(
+            options.makefilePath, session.pool, session.parseCache);
+        scope.setItems(session.parseCache.tokensLexed() - tokensBefore,
+                       "tokens");
+    }
+    var_replacement::Variables variables;
+    {
+        stats::Report::Scope scope(report, "resolve");
+        variables = var_resolution::resolveVariables(varDefs);
+        scope.setItems(varDefs.size(), "definitions");
+    }
+    std::vector<std::shared_ptr<auto_var_replacement::Rule>> expanded;
+    {
+        stats::Report::Scope scope(report, "replace");
+        scope.setItems(rules.size(), "rules");
+        expanded = replaceRules(variables, std::move(rules), session.pool);
+    }
+    {
+        stats::Report::Scope scope(report, "graph");
+        auto batchable = batch::takeBatchable(expanded);
+        rule_dep::Graph graph(expanded);
+        auto levelization = rule_dep::levelize(graph, expanded);
+        scope.setItems(graph.numNodes(), "nodes");
+        session.setBuildState(std::make_unique<BuildState>(
+            options.makefilePath, std::move(expanded), std::move(batchable),
+            std::move(graph), std::move(levelization)));
+    }
+    return *session.buildState;
+}
+
+static void invalidateTargetsOf(BuildState& state, rule_dep::NodeId node) {
+    auto rule = state.graph.ruleOf(node);
+    if (!rule.has_value()) {
+        return;
+    }
+    for (const auto& target : state.rules[rule.value()]->targets) {
+        if (auto targetNode = state.graph.find(target)) {
+            state.mtimes.invalidate(targetNode.value());
+        }
+    }
+}
+
+static void build(const Options& options, Session& session,
+                  std::ostream& out) {
+    stats::AllocationCounting counting(options.statsPath.has_value());
+    stats::Report report;
+
+    BuildState& state = loadBuildState(options, session, report);
+
+    // Pass 7: Filtering Rules
+    std::vector<rule_dep::NodeId> goals;
+    // Rules another shard builds.
+    std::vector<bool> awaited;
+    std::vector<bool> outOfDate;
+    {
+        stats::Report::Scope scope(report, "filter");
+        goals = goalNodes(options, state.graph, state.rules);
+        if (options.numShards > 1) {
+            auto partition = partition::partitionGoals(
+                state.graph, state.rules, goals, options.numShards);
+            goals = std::move(partition.goals[options.shardIndex]);
+            awaited.resize(state.rules.size());
+            for (size_t r = 0; r < state.rules.size(); r++) {
+                uint32_t owner = partition.ownerOf[r];
+                awaited[r] = owner != partition::Partition::NO_SHARD &&
+                             owner != options.shardIndex;
+            }
+        }
+        outOfDate = rule_filter::filter(state.graph, state.levelization,
+                                        goals, state.mtimes);
+        scope.setItems(std::count(outOfDate.begin(), outOfDate.end(), true),
+                       "out_of_date_nodes");
+    }
+    // Every target of the rules about to run is stat-ed again next time,
+    // even if the run fails halfway through.
+    for (rule_dep::NodeId node = 0; node < outOfDate.size(); node++) {
+        if (outOfDate[node]) {
+            invalidateTargetsOf(state, node);
+        }
+    }
+
+    // Pass 8: Submitting Rules to a Thread Pool
+    std::optional<action_cache::ActionCache> cache;
+    if (options.cacheDir.has_value()) {
+        cache.emplace(options.cacheDir.value());
+    }
+    size_t numRun = 0;
+    {
+        stats::Report::Scope scope(report, "execute");
+        auto busyBefore = session.pool.busyTime();
+        auto start = std::chrono::steady_clock::now();
+        numRun = scheduler::execute(
+            state.graph, state.rules, outOfDate, session.pool,
+            options.concurrency, cache.has_value() ? &cache.value() : nullptr,
+            out, state.batchable, options.batchSize, awaited,
+            options.shardTimeout);
+        std::chrono::duration<double> wall =
+            std::chrono::steady_clock::now() - start;
+        std::chrono::duration<double> busy =
+            session.pool.busyTime() - busyBefore;
+        report.workers = session.pool.size();
+        if (wall.count() > 0) {
+            report.workerUtilization =
+                busy.count() / (wall.count() * session.pool.size());
+        }
+        scope.setItems(numRun, "rules");
+    }
+    if (numRun == 0 && goals.empty()) {
+        out << "Nothing to be done for shard " << options.shardIndex + 1 << '/'
+            << options.numShards << ".\n";
+    } else if (numRun == 0) {
+        for (auto g : goals) {
+            out << "Nothing to be done for '" << state.graph.name(g) << "'.\n";
+        }
+    }
+
+    if (options.statsPath.has_value()) {
+        if (options.statsPath.value() == "-") {
+            out << report.toJson() << std::endl;
+        } else {
+            std::ofstream fout(options.statsPath.value());
+            if (!fout.is_open()) {
+                throw std::runtime_error("can't write stats, path: " +
+                                         options.statsPath->string());
+            }
+            fout << report.toJson() << '\n';
+        }
+    }
+}
+
+/**
+ * @brief Prints the output of every pass up to the dependency graph.
+ */
+static void dump(const Options& options, Session& session, std::ostream& out) {
+    out << options.concurrency << ' ' << options.makefilePath << std::endl;
+
+    std::string input = makefile_loader::readFile(options.makefilePath);
+
+    // Pass 1: Lexing
+    auto tokens = lexer::lex(input);
+    size_t lineno = 1;
+    out << lineno << ": ";
+    for (const auto& token : tokens) {
+        out << lexer::toString(token) << ' ';
+        size_t tokenLineno = lexer::linenoOf(token);
+        if (tokenLineno > lineno) {
+            for (size_t i = lineno + 1; i <= tokenLineno; i++) {
+                out << '\n' << i << ": ";
+            }
+            lineno = tokenLineno;
+        }
+    }
+    out << "\n";
+
+    // Pass 2: Parsing (including `include`d Makefiles)
+    auto [varDefs, rules] = makefile_loader::load(
+        options.makefilePath, session.pool, session.parseCache);
+    out << "Variable Definitions\n";
+    for (const auto& vd : varDefs) {
+        out << vd.toString() << "\n";
+    }
+    out << "Rules:\n";
+    for (const auto& r : rules) {
+        out << r.toString() << "\n";
+    }
+
+    // Pass 3-5
+    auto expanded = expandRules(varDefs, std::move(rules), session.pool);
+    out << "Expanded Rules:\n";
+    for (const auto& r : expanded) {
+        out << r->toString() << "\n";
+    }
+
+    // Pass 6: Rule Dependency Graph Construction
+    batch::takeBatchable(expanded);
+    rule_dep::Graph graph(expanded);
+    auto levelization = rule_dep::levelize(graph, expanded);
+    out << "Dependency Graph: " << graph.numNodes() << " nodes, "
+        << levelization.levels.size() << " levels\n";
+}
+
+void run(const Options& options, Session& session, std::ostream& out) {
+    session.parseCache.setDirectory(
+        options.cacheDir.has_value()
+            ? std::optional(options.cacheDir.value() / "parse")
+            : std::nullopt);
+    if (options.affectedBy.has_value()) {
+        queryAffected(options, session, out);
+    } else if (options.dump) {
+        dump(options, session, out);
+    } else {
+        build(options, session, out);
+    }
+}
+
+void reportError(const std::exception& error, std::ostream& err) {
+    err << "TinyMake: *** " << error.what() << std::endl;
+}
+}  // namespace driver
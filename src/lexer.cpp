@@ -1,26 +1,42 @@
 #include "lexer.h"
 
 #include <cstddef>
-#include <memory>
+#include <iterator>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace lexer {
 
+/**
+ * @brief Lexed token, remaining input and line number after it, if the input
+ * starts with a token of the lexer's kind.
+ */
+using LexResult = std::optional<std::tuple<Token, std::string_view, size_t>>;
+
 static bool isInCharSet(char c) {
-    std::unordered_set<char> specialChars{'_', '.', '%', '/',
-                                          '-', ',', '@', '\''};
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
-           (c >= '0' && c <= '9') || specialChars.contains(c);
+    switch (c) {
+        case '_':
+        case '.':
+        case '%':
+        case '/':
+        case '-':
+        case ',':
+        case '@':
+        case '\'':
+            return true;
+        default:
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                   (c >= '0' && c <= '9');
+    }
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexWord(std::string_view charStream, size_t lineno) {
+static LexResult lexWord(std::string_view charStream, size_t lineno) {
     std::string name;
     while (!charStream.empty()) {
         char c = charStream.front();
@@ -34,12 +50,10 @@ lexWord(std::string_view charStream, size_t lineno) {
     if (name.empty()) {
         return {};
     }
-    return {{std::make_shared<Word>(name, lineno), charStream, lineno}};
+    return {{Word(name, lineno), charStream, lineno}};
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexVar(std::string_view charStream, size_t lineno) {
+static LexResult lexVar(std::string_view charStream, size_t lineno) {
     if (charStream.starts_with("$(")) {
         charStream = charStream.substr(2);
         while (!charStream.empty() && charStream.front() == ' ') {
@@ -54,8 +68,7 @@ lexVar(std::string_view charStream, size_t lineno) {
                 charStream = charStream.substr(1);
             }
             if (!charStream.empty() && charStream.front() == ')') {
-                return {{std::make_shared<Var>(
-                             dynamic_pointer_cast<Word>(word)->name, lineno),
+                return {{Var(std::get<Word>(word).name, lineno),
                          charStream.substr(1), lineno}};
             } else {
                 return {};
@@ -66,19 +79,16 @@ lexVar(std::string_view charStream, size_t lineno) {
     } else if (charStream.starts_with('$')) {
         charStream = charStream.substr(1);
         if (charStream.empty()) {
-            return {{std::make_shared<Word>("$", lineno), charStream.substr(1),
-                     lineno}};
+            return {{Word("$", lineno), charStream.substr(1), lineno}};
         }
         char c = charStream.front();
         if (isInCharSet(c)) {
-            return {{std::make_shared<Var>(std::string(1, c), lineno),
-                     charStream.substr(1), lineno}};
-        } else if (c == ' ') {
-            return {{std::make_shared<Word>("", lineno), charStream.substr(1),
+            return {{Var(std::string(1, c), lineno), charStream.substr(1),
                      lineno}};
+        } else if (c == ' ') {
+            return {{Word("", lineno), charStream.substr(1), lineno}};
         } else if (c == '$' || c == '\n') {
-            return {{std::make_shared<Word>("$", lineno), charStream.substr(1),
-                     lineno}};
+            return {{Word("$", lineno), charStream.substr(1), lineno}};
         } else {
             return {};
         }
@@ -87,29 +97,25 @@ lexVar(std::string_view charStream, size_t lineno) {
     }
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexAutoVar(std::string_view charStream, size_t lineno) {
+static LexResult lexAutoVar(std::string_view charStream, size_t lineno) {
     if (charStream.starts_with("$@")) {
-        return {{std::make_shared<AutoVar>(AutoVar::DOLLAR_AT, lineno),
-                 charStream.substr(2), lineno}};
+        return {{AutoVar(AutoVar::DOLLAR_AT, lineno), charStream.substr(2),
+                 lineno}};
     } else if (charStream.starts_with("$<")) {
-        return {{std::make_shared<AutoVar>(AutoVar::DOLLAR_LT, lineno),
-                 charStream.substr(2), lineno}};
+        return {{AutoVar(AutoVar::DOLLAR_LT, lineno), charStream.substr(2),
+                 lineno}};
     } else if (charStream.starts_with("$^")) {
-        return {{std::make_shared<AutoVar>(AutoVar::DOLLAR_SUP, lineno),
-                 charStream.substr(2), lineno}};
+        return {{AutoVar(AutoVar::DOLLAR_SUP, lineno), charStream.substr(2),
+                 lineno}};
     } else {
         return {};
     }
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexString(std::string_view charStream, size_t lineno) {
+static LexResult lexString(std::string_view charStream, size_t lineno) {
     if (charStream.starts_with('"')) {
         charStream = charStream.substr(1);
-        std::vector<std::variant<std::string, Var, AutoVar>> segments;
+        std::vector<String::Segment> segments;
         std::string curSeg;
         while (!charStream.empty()) {
             char c = charStream.front();
@@ -127,19 +133,27 @@ lexString(std::string_view charStream, size_t lineno) {
                     curSeg.clear();
                 }
 
-                auto tryVarRes = lexVar(charStream, lineno);
-                if (tryVarRes.has_value()) {
-                    auto [var, nextInputView, nextLineno] = tryVarRes.value();
-                    segments.emplace_back(*std::dynamic_pointer_cast<Var>(var));
+                // `$@` must not be taken for a variable named "@".
+                auto tryAutoVarRes = lexAutoVar(charStream, lineno);
+                if (tryAutoVarRes.has_value()) {
+                    auto [autoVar, nextInputView, nextLineno] =
+                        tryAutoVarRes.value();
+                    segments.emplace_back(std::get<AutoVar>(autoVar));
                     charStream = nextInputView;
                     lineno = nextLineno;
                 } else {
-                    auto tryAutoVarRes = lexAutoVar(charStream, lineno);
-                    if (tryAutoVarRes.has_value()) {
-                        auto [autoVar, nextInputView, nextLineno] =
-                            tryAutoVarRes.value();
-                        segments.emplace_back(
-                            *std::dynamic_pointer_cast<Var>(autoVar));
+                    auto tryVarRes = lexVar(charStream, lineno);
+                    if (tryVarRes.has_value()) {
+                        auto [var, nextInputView, nextLineno] =
+                            tryVarRes.value();
+                        if (std::holds_alternative<Var>(var)) {
+                            segments.emplace_back(std::get<Var>(var));
+                        } else if (charStream.starts_with("$$")) {
+                            segments.emplace_back(Dollar());
+                        } else {
+                            // `$ ` is literal text.
+                            curSeg += std::get<Word>(var).name;
+                        }
                         charStream = nextInputView;
                         lineno = nextLineno;
                     } else {
@@ -166,54 +180,41 @@ lexString(std::string_view charStream, size_t lineno) {
                 charStream = charStream.substr(1);
             }
         }
-        return {
-            {std::make_shared<String>(segments, lineno), charStream, lineno}};
+        return {{String(segments, lineno), charStream, lineno}};
     } else {
         return {};
     }
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexEqual(std::string_view charStream, size_t lineno) {
+static LexResult lexEqual(std::string_view charStream, size_t lineno) {
     if (charStream.starts_with('=')) {
-        return {
-            {std::make_shared<Equal>(lineno), charStream.substr(1), lineno}};
+        return {{Equal(lineno), charStream.substr(1), lineno}};
     } else if (charStream.starts_with(":=")) {
-        return {
-            {std::make_shared<Equal>(lineno), charStream.substr(2), lineno}};
+        return {{Equal(lineno), charStream.substr(2), lineno}};
     } else {
         return {};
     }
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexColon(std::string_view charStream, size_t lineno) {
+static LexResult lexColon(std::string_view charStream, size_t lineno) {
     if (charStream.starts_with(':')) {
-        return {
-            {std::make_shared<Colon>(lineno), charStream.substr(1), lineno}};
+        return {{Colon(lineno), charStream.substr(1), lineno}};
     } else {
         return {};
     }
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexTab(std::string_view charStream, size_t lineno) {
+static LexResult lexTab(std::string_view charStream, size_t lineno) {
     if (charStream.starts_with('\t')) {
-        return {{std::make_shared<Tab>(lineno), charStream.substr(1), lineno}};
+        return {{Tab(lineno), charStream.substr(1), lineno}};
     } else {
         return {};
     }
 }
 
-static std::optional<
-    std::tuple<std::shared_ptr<Token>, std::string_view, size_t>>
-lexEndl(std::string_view charStream, size_t lineno) {
+static LexResult lexEndl(std::string_view charStream, size_t lineno) {
     if (charStream.starts_with('\n')) {
-        return {
-            {std::make_shared<Endl>(lineno), charStream.substr(1), lineno + 1}};
+        return {{Endl(lineno), charStream.substr(1), lineno + 1}};
     }
     return {};
 }
@@ -232,30 +233,62 @@ static std::string_view lexIgnore(std::string_view charStream) {
     return charStream;
 }
 
-std::vector<std::shared_ptr<Token>> lex(const std::string& sourceCode) {
-    std::vector lexers{lexWord,  lexVar,   lexAutoVar, lexString,
-                       lexEqual, lexColon, lexTab,     lexEndl};
+/**
+ * @brief Sets `joined` of `token` if it is word-like.
+ *
+ * @return Whether `token` is word-like.
+ */
+static bool setJoined(Token& token, bool joined) {
+    return std::visit(
+        [joined](auto& t) {
+            if constexpr (requires { t.joined; }) {
+                t.joined = joined;
+                return true;
+            } else {
+                return false;
+            }
+        },
+        token);
+}
+
+Generator<std::vector<Token>> lexLines(std::string_view sourceCode) {
+    // `lexAutoVar` goes first, `$@` must not be taken for a variable named "@".
+    std::vector lexers{lexAutoVar, lexWord,  lexVar, lexString,
+                       lexEqual,   lexColon, lexTab, lexEndl};
     std::string_view charStream(sourceCode);
-    std::vector<std::shared_ptr<Token>> tokenStream;
+    std::vector<Token> line;
     size_t lineno = 1;
+    // Whether whitespace or a token that is not word-like precedes the next
+    // token.
+    bool separated = true;
     while (true) {
-        charStream = lexIgnore(charStream);
+        std::string_view rest = lexIgnore(charStream);
+        separated = separated || rest.size() != charStream.size();
+        charStream = rest;
         if (charStream.empty()) {
             break;
         }
         if (charStream.starts_with("\\\n")) {
             lineno++;
             charStream = charStream.substr(2);
+            separated = true;
         } else {
             bool successful = false;
             for (auto lexer : lexers) {
                 auto res = lexer(charStream, lineno);
                 if (res.has_value()) {
-                    auto [token, nextInputView, nextLineno] = res.value();
-                    tokenStream.emplace_back(token);
+                    auto [token, nextInputView, nextLineno] =
+                        std::move(res.value());
+                    separated = !setJoined(token, !separated);
+                    bool isEndl = std::holds_alternative<Endl>(token);
+                    line.emplace_back(std::move(token));
                     charStream = nextInputView;
                     lineno = nextLineno;
                     successful = true;
+                    if (isEndl) {
+                        co_yield std::move(line);
+                        line.clear();
+                    }
                     break;
                 }
             }
@@ -267,6 +300,18 @@ std::vector<std::shared_ptr<Token>> lex(const std::string& sourceCode) {
             }
         }
     }
+    if (!line.empty()) {
+        co_yield std::move(line);
+    }
+}
+
+std::vector<Token> lex(const std::string& sourceCode) {
+    std::vector<Token> tokenStream;
+    for (auto& line : lexLines(sourceCode)) {
+        tokenStream.insert(tokenStream.end(),
+                           std::make_move_iterator(line.begin()),
+                           std::make_move_iterator(line.end()));
+    }
     return tokenStream;
 }
 }  // namespace lexer
@@ -0,0 +1,326 @@
+#include "makefile-loader.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "digest.h"
+#include "generator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "statement-codec.h"
+#include "thread-pool.h"
+
+namespace makefile_loader {
+
+namespace fs = std::filesystem;
+
+std::string readFile(const fs::path& path) {
+    std::ifstream fin(path);
+    if (!fin.is_open()) {
+        throw LoaderException({"can't open makefile, path:", path.string()});
+    }
+    // Get the file size
+    fin.seekg(0, std::ios::end);
+    const std::streamsize fileSize = fin.tellg();
+    fin.seekg(0, std::ios::beg);
+    std::string input(fileSize, 0);
+    fin.read(input.data(), fileSize);
+    input.resize(fin.gcount());  // In Windows, "\r\n" will be transformed into
+                                 // "\n", so bytes read can be less than file
+                                 // size
+    return input;
+}
+
+static Generator<std::vector<lexer::Token>> countTokens(
+    Generator<std::vector<lexer::Token>> lines,
+    std::atomic<uint64_t>& counter) {
+    for (auto& line : lines) {
+        counter += line.size();
+        co_yield std::move(line);
+    }
+}
+
+// First line of a persisted entry, bumped whenever the format changes.
+static constexpr std::string_view PERSISTED_HEADER = "TinyMake parse cache 1";
+
+static fs::path tempPathFor(const fs::path& path) {
+    static std::atomic<size_t> counter = 0;
+    return path.string() + ".tmp." + std::to_string(::getpid()) + "." +
+           std::to_string(counter++);
+}
+
+void ParseCache::setDirectory(const std::optional<fs::path>& dir) {
+    if (dir.has_value()) {
+        fs::create_directories(dir.value());
+    }
+    directory = dir;
+}
+
+/**
+ * @brief Reads the persisted entry of `key`. Entries that are missing,
+ * written for another path or corrupted are all misses.
+ */
+std::optional<ParseCache::Entry> ParseCache::readPersisted(
+    const std::string& key) const {
+    std::ifstream fin(directory.value() / digest::hashString(key),
+                      std::ios::binary);
+    std::string header;
+    std::string persistedKey;
+    std::string mtime;
+    std::string contentHash;
+    if (!std::getline(fin, header) || header != PERSISTED_HEADER ||
+        !std::getline(fin, persistedKey) || persistedKey != key ||
+        !std::getline(fin, mtime) || !std::getline(fin, contentHash)) {
+        return {};
+    }
+    fs::file_time_type::rep count = 0;
+    auto [end, ec] =
+        std::from_chars(mtime.data(), mtime.data() + mtime.size(), count);
+    if (ec != std::errc() || end != mtime.data() + mtime.size()) {
+        return {};
+    }
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    try {
+        return Entry{fs::file_time_type(fs::file_time_type::duration(count)),
+                     contentHash,
+                     std::make_shared<const std::vector<parser::Statement>>(
+                         statement_codec::decode(data))};
+    } catch (const statement_codec::CodecException&) {
+        return {};
+    }
+}
+
+/**
+ * @brief Writes `entry` to a temporary file and renames it into place, so
+ * that concurrent runs sharing the directory never read a partial entry.
+ * Failing to persist only costs a re-parse in the next run.
+ */
+void ParseCache::persist(const std::string& key, const Entry& entry) const {
+    fs::path path = directory.value() / digest::hashString(key);
+    fs::path tmp = tempPathFor(path);
+    {
+        std::ofstream fout(tmp, std::ios::binary);
+        if (!fout.is_open()) {
+            return;
+        }
+        fout << PERSISTED_HEADER << '\n'
+             << key << '\n'
+             << entry.mtime.time_since_epoch().count() << '\n'
+             << entry.contentHash << '\n'
+             << statement_codec::encode(*entry.statements);
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+    }
+}
+
+std::shared_ptr<const std::vector<parser::Statement>> ParseCache::get(
+    const fs::path& path) {
+    const std::string key = fs::absolute(path).lexically_normal().string();
+    const fs::file_time_type mtime = fs::last_write_time(path);
+    {
+        std::lock_guard lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.mtime == mtime) {
+            return it->second.statements;
+        }
+    }
+    std::optional<Entry> persisted;
+    if (directory.has_value()) {
+        persisted = readPersisted(key);
+        if (persisted.has_value() && persisted->mtime == mtime) {
+            std::lock_guard lock(mutex);
+            entries.insert_or_assign(key, persisted.value());
+            return persisted->statements;
+        }
+    }
+
+    std::string input = readFile(path);
+    std::string contentHash = digest::hashString(input);
+    std::optional<Entry> reused;
+    {
+        std::lock_guard lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.contentHash == contentHash) {
+            it->second.mtime = mtime;
+            reused = it->second;
+        }
+    }
+    if (!reused.has_value() && persisted.has_value() &&
+        persisted->contentHash == contentHash) {
+        persisted->mtime = mtime;
+        reused = std::move(persisted);
+        std::lock_guard lock(mutex);
+        entries.insert_or_assign(key, reused.value());
+    }
+    if (reused.has_value()) {
+        // Only the mtime changed, record it so that the next run hits early.
+        if (directory.has_value()) {
+            persist(key, reused.value());
+        }
+        return reused->statements;
+    }
+
+    Entry entry{mtime, contentHash, nullptr};
+    try {
+        entry.statements =
+            std::make_shared<const std::vector<parser::Statement>>(
+                parser::parseStatements(
+                    countTokens(lexer::lexLines(input), numTokensLexed)));
+    } catch (const RuntimeException& e) {
+        throw LoaderException({path.string() + ":", e.what()});
+    }
+    if (directory.has_value()) {
+        persist(key, entry);
+    }
+    std::lock_guard lock(mutex);
+    entries.insert_or_assign(key, entry);
+    return entry.statements;
+}
+
+void ParseCache::recordMissing(const fs::path& path) {
+    std::lock_guard lock(mutex);
+    missing.insert(fs::absolute(path).lexically_normal().string());
+}
+
+bool ParseCache::invalidate(const fs::path& path) {
+    const std::string key = fs::absolute(path).lexically_normal().string();
+    std::lock_guard lock(mutex);
+    bool wasMissing = missing.erase(key) > 0;
+    return entries.erase(key) > 0 || wasMissing;
+}
+
+std::vector<fs::path> ParseCache::paths() const {
+    std::lock_guard lock(mutex);
+    std::vector<fs::path> result;
+    result.reserve(entries.size() + missing.size());
+    for (const auto& [key, entry] : entries) {
+        result.emplace_back(key);
+    }
+    result.insert(result.end(), missing.begin(), missing.end());
+    return result;
+}
+
+using Flattened = std::vector<std::variant<parser::VarDef, parser::Rule>>;
+
+static void appendStatement(const parser::Statement& s, Flattened& out) {
+    if (std::holds_alternative<parser::VarDef>(s)) {
+        out.emplace_back(std::get<parser::VarDef>(s));
+    } else {
+        out.emplace_back(std::get<parser::Rule>(s));
+    }
+}
+
+/**
+ * @brief Loads `path` and expands its includes depth-first on the calling
+ * thread. `chain` holds the files currently being expanded, to detect cycles.
+ */
+static void expand(const fs::path& path, bool optional, ParseCache& cache,
+                   std::vector<fs::path>& chain, Flattened& out) {
+    if (!fs::exists(path)) {
+        if (optional) {
+            cache.recordMissing(path);
+            return;
+        }
+        throw LoaderException({"included makefile not found, path:",
+                               path.string()});
+    }
+    fs::path canonical = fs::canonical(path);
+    for (const auto& p : chain) {
+        if (p == canonical) {
+            throw LoaderException({"recursive include of", path.string()});
+        }
+    }
+    chain.emplace_back(canonical);
+    for (const auto& s : *cache.get(path)) {
+        if (std::holds_alternative<parser::Include>(s)) {
+            const auto& include = std::get<parser::Include>(s);
+            for (const auto& p : include.paths) {
+                expand(p.name, include.optional, cache, chain, out);
+            }
+        } else {
+            appendStatement(s, out);
+        }
+    }
+    chain.pop_back();
+}
+
+std::pair<std::vector<parser::VarDef>, std::vector<parser::Rule>> load(
+    const fs::path& makefile, thread_pool::ThreadPool& pool,
+    ParseCache& cache) {
+    const fs::path root = fs::canonical(makefile);
+    auto statements = cache.get(makefile);
+
+    // Submit every top-level include first so that they are all in flight
+    // before the merge below starts waiting on the first one.
+    std::vector<std::future<Flattened>> included;
+    for (const auto& s : *statements) {
+        if (std::holds_alternative<parser::Include>(s)) {
+            const auto& include = std::get<parser::Include>(s);
+            for (const auto& p : include.paths) {
+                fs::path path = p.name;
+                bool optional = include.optional;
+                included.emplace_back(
+                    pool.submit([path, optional, root, &cache] {
+                        std::vector<fs::path> chain{root};
+                        Flattened out;
+                        expand(path, optional, cache, chain, out);
+                        return out;
+                    }));
+            }
+        }
+    }
+
+    std::vector<parser::VarDef> varDefs;
+    std::vector<parser::Rule> rules;
+    auto append = [&](std::variant<parser::VarDef, parser::Rule>&& s) {
+        if (std::holds_alternative<parser::VarDef>(s)) {
+            varDefs.emplace_back(std::move(std::get<parser::VarDef>(s)));
+        } else {
+            rules.emplace_back(std::move(std::get<parser::Rule>(s)));
+        }
+    };
+    size_t nextIncluded = 0;
+    try {
+        for (const auto& s : *statements) {
+            if (std::holds_alternative<parser::Include>(s)) {
+                const auto& include = std::get<parser::Include>(s);
+                for (size_t i = 0; i < include.paths.size(); i++) {
+                    for (auto& statement : included[nextIncluded++].get()) {
+                        append(std::move(statement));
+                    }
+                }
+            } else if (std::holds_alternative<parser::VarDef>(s)) {
+                varDefs.emplace_back(std::get<parser::VarDef>(s));
+            } else {
+                rules.emplace_back(std::get<parser::Rule>(s));
+            }
+        }
+    } catch (...) {
+        // Outstanding tasks still reference `cache`, don't leave them behind.
+        for (; nextIncluded < included.size(); nextIncluded++) {
+            included[nextIncluded].wait();
+        }
+        throw;
+    }
+    return {varDefs, rules};
+}
+}  // namespace makefile_loader
@@ -2,35 +2,60 @@
 
 #include <cstdlib>
 #include <iostream>
-#include <memory>
+#include <iterator>
 #include <optional>
 #include <span>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "generator.h"
 #include "lexer.h"
 
 namespace parser {
-static std::optional<
-    std::pair<VarDef, std::span<const std::shared_ptr<lexer::Token>>>>
-parseVarDef(std::span<const std::shared_ptr<lexer::Token>> tokenStream) {
-    if (tokenStream.size() >= 2 && tokenStream[0]->tokenType() == lexer::WORD &&
-        tokenStream[1]->tokenType() == lexer::EQUAL) {
-        lexer::Word varName =
-            *std::dynamic_pointer_cast<lexer::Word>(tokenStream[0]);
+
+using TokenSpan = std::span<const lexer::Token>;
+
+template <typename T>
+static bool startsWith(TokenSpan tokenStream) {
+    return !tokenStream.empty() &&
+           std::holds_alternative<T>(tokenStream.front());
+}
+
+/**
+ * @brief Appends `token` to `out` if its kind is one of `out`'s
+ * alternatives. Which kinds are accepted is decided at compile time, so this
+ * is a single jump on the token's index.
+ */
+template <typename... Alternatives>
+static bool appendIfOneOf(const lexer::Token& token,
+                          std::vector<std::variant<Alternatives...>>& out) {
+    return std::visit(
+        [&out](const auto& t) {
+            using T = std::decay_t<decltype(t)>;
+            if constexpr ((std::is_same_v<T, Alternatives> || ...)) {
+                out.emplace_back(t);
+                return true;
+            } else {
+                return false;
+            }
+        },
+        token);
+}
+
+static std::optional<std::pair<VarDef, TokenSpan>> parseVarDef(
+    TokenSpan tokenStream) {
+    if (tokenStream.size() >= 2 &&
+        std::holds_alternative<lexer::Word>(tokenStream[0]) &&
+        std::holds_alternative<lexer::Equal>(tokenStream[1])) {
+        lexer::Word varName = std::get<lexer::Word>(tokenStream[0]);
         tokenStream = tokenStream.subspan(2);
 
         std::vector<std::variant<lexer::Word, lexer::Var>> values;
-        while (!tokenStream.empty() &&
-               tokenStream.front()->tokenType() != lexer::ENDL) {
-            std::shared_ptr<lexer::Token> t = tokenStream.front();
-            if (t->tokenType() == lexer::WORD) {
-                values.emplace_back(*std::dynamic_pointer_cast<lexer::Word>(t));
-            } else if (t->tokenType() == lexer::VAR) {
-                values.emplace_back(*std::dynamic_pointer_cast<lexer::Var>(t));
-            } else {
+        while (!tokenStream.empty() && !startsWith<lexer::Endl>(tokenStream)) {
+            if (!appendIfOneOf(tokenStream.front(), values)) {
                 return {};
             }
             tokenStream = tokenStream.subspan(1);
@@ -40,64 +65,39 @@ parseVarDef(std::span<const std::shared_ptr<lexer::Token>> tokenStream) {
     return {};
 }
 
-static std::optional<
-    std::pair<Rule, std::span<const std::shared_ptr<lexer::Token>>>>
-parseRule(std::span<const std::shared_ptr<lexer::Token>> tokenStream) {
-    if (!(!tokenStream.empty() &&
-          (tokenStream.front()->tokenType() == lexer::WORD ||
-           tokenStream.front()->tokenType() == lexer::VAR))) {
+static std::optional<std::pair<Rule, TokenSpan>> parseRule(
+    TokenSpan tokenStream) {
+    if (!startsWith<lexer::Word>(tokenStream) &&
+        !startsWith<lexer::Var>(tokenStream)) {
         return {};
     }
 
     std::vector<std::variant<lexer::Word, lexer::Var>> targets;
-    while (!tokenStream.empty() &&
-           tokenStream.front()->tokenType() != lexer::COLON) {
-        auto t = tokenStream.front();
-        if (t->tokenType() == lexer::WORD) {
-            targets.emplace_back(
-                *std::dynamic_pointer_cast<lexer::Word>(tokenStream.front()));
-            tokenStream = tokenStream.subspan(1);
-        } else if (t->tokenType() == lexer::VAR) {
-            targets.emplace_back(
-                *std::dynamic_pointer_cast<lexer::Var>(tokenStream.front()));
-            tokenStream = tokenStream.subspan(1);
-        } else {
+    while (!tokenStream.empty() && !startsWith<lexer::Colon>(tokenStream)) {
+        if (!appendIfOneOf(tokenStream.front(), targets)) {
             return {};
         }
+        tokenStream = tokenStream.subspan(1);
     }
 
-    if (!(!tokenStream.empty() &&
-          tokenStream.front()->tokenType() == lexer::COLON)) {
+    if (!startsWith<lexer::Colon>(tokenStream)) {
         return {};
     }
     tokenStream = tokenStream.subspan(1);
 
     std::vector<std::variant<lexer::Word, lexer::Var>> prereqs;
-    while (!tokenStream.empty() &&
-           tokenStream.front()->tokenType() != lexer::ENDL) {
-        auto t = tokenStream.front();
-        if (t->tokenType() == lexer::WORD) {
-            prereqs.emplace_back(
-                *std::dynamic_pointer_cast<lexer::Word>(tokenStream.front()));
-            tokenStream = tokenStream.subspan(1);
-        } else if (t->tokenType() == lexer::VAR) {
-            prereqs.emplace_back(
-                *std::dynamic_pointer_cast<lexer::Var>(tokenStream.front()));
-            tokenStream = tokenStream.subspan(1);
+    while (!tokenStream.empty() && !startsWith<lexer::Endl>(tokenStream)) {
+        if (!appendIfOneOf(tokenStream.front(), prereqs)) {
+            return {};
         }
-    }
-
-    if (!tokenStream.empty() &&
-        tokenStream.front()->tokenType() != lexer::ENDL) {
-        return {};
+        tokenStream = tokenStream.subspan(1);
     }
 
     std::vector<std::vector<
         std::variant<lexer::Word, lexer::Var, lexer::AutoVar, lexer::String>>>
         recipes;
     while (true) {
-        while (!tokenStream.empty() &&
-               tokenStream.front()->tokenType() == lexer::ENDL) {
+        while (startsWith<lexer::Endl>(tokenStream)) {
             tokenStream = tokenStream.subspan(1);
         }
         if (tokenStream.empty()) {
@@ -106,39 +106,21 @@ parseRule(std::span<const std::shared_ptr<lexer::Token>> tokenStream) {
 
         // Parse exactly one line
 
-        if (tokenStream.front()->tokenType() != lexer::TAB) {
+        if (!startsWith<lexer::Tab>(tokenStream)) {
             break;
         }
-        while (!tokenStream.empty() &&
-               tokenStream.front()->tokenType() == lexer::TAB) {
+        while (startsWith<lexer::Tab>(tokenStream)) {
             tokenStream = tokenStream.subspan(1);
         }
 
         std::vector<std::variant<lexer::Word, lexer::Var, lexer::AutoVar,
                                  lexer::String>>
             recipe;
-        while (!tokenStream.empty() &&
-               tokenStream.front()->tokenType() != lexer::ENDL) {
-            std::shared_ptr<lexer::Token> t = tokenStream.front();
-            if (t->tokenType() == lexer::WORD) {
-                recipe.emplace_back(*std::dynamic_pointer_cast<lexer::Word>(
-                    tokenStream.front()));
-                tokenStream = tokenStream.subspan(1);
-            } else if (t->tokenType() == lexer::VAR) {
-                recipe.emplace_back(*std::dynamic_pointer_cast<lexer::Var>(
-                    tokenStream.front()));
-                tokenStream = tokenStream.subspan(1);
-            } else if (t->tokenType() == lexer::AUTO_VAR) {
-                recipe.emplace_back(*std::dynamic_pointer_cast<lexer::AutoVar>(
-                    tokenStream.front()));
-                tokenStream = tokenStream.subspan(1);
-            } else if (t->tokenType() == lexer::STRING) {
-                recipe.emplace_back(*std::dynamic_pointer_cast<lexer::String>(
-                    tokenStream.front()));
-                tokenStream = tokenStream.subspan(1);
-            } else {
+        while (!tokenStream.empty() && !startsWith<lexer::Endl>(tokenStream)) {
+            if (!appendIfOneOf(tokenStream.front(), recipe)) {
                 return {};
             }
+            tokenStream = tokenStream.subspan(1);
         }
         if (!recipe.empty()) {
             recipes.emplace_back(recipe);
@@ -147,14 +129,39 @@ parseRule(std::span<const std::shared_ptr<lexer::Token>> tokenStream) {
     return {{Rule(targets, prereqs, recipes), tokenStream}};
 }
 
-std::pair<std::vector<VarDef>, std::vector<Rule>> parse(
-    std::vector<std::shared_ptr<lexer::Token>> tokens) {
-    std::span<const std::shared_ptr<lexer::Token>> tokenStream(tokens);
-    std::vector<VarDef> varDefs;
-    std::vector<Rule> rules;
+static std::optional<std::pair<Include, TokenSpan>> parseInclude(
+    TokenSpan tokenStream) {
+    if (!startsWith<lexer::Word>(tokenStream)) {
+        return {};
+    }
+    const auto& directive = std::get<lexer::Word>(tokenStream.front());
+    if (directive.name != "include" && directive.name != "-include") {
+        return {};
+    }
+    size_t lineno = directive.lineno;
+    auto rest = tokenStream.subspan(1);
+
+    std::vector<lexer::Word> paths;
+    while (!rest.empty() && !startsWith<lexer::Endl>(rest)) {
+        if (const auto* word = std::get_if<lexer::Word>(&rest.front())) {
+            paths.emplace_back(*word);
+        } else if (startsWith<lexer::Var>(rest)) {
+            throw ParserException({"Variables in include paths are not "
+                                   "supported, line:",
+                                   std::to_string(lineno)});
+        } else {
+            // e.g. `include: foo`, a rule whose target is named "include"
+            return {};
+        }
+        rest = rest.subspan(1);
+    }
+    return {{Include(paths, directive.name == "-include", lineno), rest}};
+}
+
+static void parseTokens(TokenSpan tokenStream,
+                        std::vector<Statement>& statements) {
     while (true) {
-        while (!tokenStream.empty() &&
-               tokenStream.front()->tokenType() == lexer::ENDL) {
+        while (startsWith<lexer::Endl>(tokenStream)) {
             tokenStream = tokenStream.subspan(1);
         }
         if (tokenStream.empty()) {
@@ -164,7 +171,15 @@ std::pair<std::vector<VarDef>, std::vector<Rule>> parse(
         auto tryVarDefRes = parseVarDef(tokenStream);
         if (tryVarDefRes.has_value()) {
             auto [varDef, nextTokenStream] = tryVarDefRes.value();
-            varDefs.emplace_back(std::move(varDef));
+            statements.emplace_back(std::move(varDef));
+            tokenStream = nextTokenStream;
+            continue;
+        }
+
+        auto tryIncludeRes = parseInclude(tokenStream);
+        if (tryIncludeRes.has_value()) {
+            auto [include, nextTokenStream] = tryIncludeRes.value();
+            statements.emplace_back(std::move(include));
             tokenStream = nextTokenStream;
             continue;
         }
@@ -172,18 +187,70 @@ std::pair<std::vector<VarDef>, std::vector<Rule>> parse(
         auto tryRuleRes = parseRule(tokenStream);
         if (tryRuleRes.has_value()) {
             auto [rule, nextTokenStream] = tryRuleRes.value();
-            rules.emplace_back(std::move(rule));
+            statements.emplace_back(std::move(rule));
             tokenStream = nextTokenStream;
             continue;
         }
         break;
     }
-    if (tokenStream.empty()) {
-        return {varDefs, rules};
-    } else {
+    if (!tokenStream.empty()) {
         throw ParserException(
-            {"Parse fail at line:", std::to_string(tokenStream.front()->lineno),
-             ", next token", tokenStream.front()->toString()});
+            {"Parse fail at line:",
+             std::to_string(lexer::linenoOf(tokenStream.front())),
+             ", next token", lexer::toString(tokenStream.front())});
     }
 }
-}  // namespace parser
\ No newline at end of file
+
+static std::pair<std::vector<VarDef>, std::vector<Rule>> splitStatements(
+    std::vector<Statement>&& statements) {
+    std::vector<VarDef> varDefs;
+    std::vector<Rule> rules;
+    for (auto& s : statements) {
+        if (std::holds_alternative<VarDef>(s)) {
+            varDefs.emplace_back(std::move(std::get<VarDef>(s)));
+        } else if (std::holds_alternative<Rule>(s)) {
+            rules.emplace_back(std::move(std::get<Rule>(s)));
+        } else {
+            throw ParserException(
+                {"include directive at line:",
+                 std::to_string(std::get<Include>(s).lineno),
+                 "can only be used when loading a Makefile from a file"});
+        }
+    }
+    return {varDefs, rules};
+}
+
+std::vector<Statement> parseStatements(
+    Generator<std::vector<lexer::Token>> lines) {
+    std::vector<Statement> statements;
+    // A statement spans its first line plus the following recipe (tab-led)
+    // and blank lines, so it is complete once a line starts with anything
+    // else. Only one statement is buffered at a time.
+    std::vector<lexer::Token> statement;
+    for (auto& line : lines) {
+        if (!line.empty() &&
+            !std::holds_alternative<lexer::Tab>(line.front()) &&
+            !std::holds_alternative<lexer::Endl>(line.front())) {
+            parseTokens(statement, statements);
+            statement.clear();
+        }
+        statement.insert(statement.end(),
+                         std::make_move_iterator(line.begin()),
+                         std::make_move_iterator(line.end()));
+    }
+    parseTokens(statement, statements);
+    return statements;
+}
+
+std::pair<std::vector<VarDef>, std::vector<Rule>> parse(
+    const std::vector<lexer::Token>& tokens) {
+    std::vector<Statement> statements;
+    parseTokens(tokens, statements);
+    return splitStatements(std::move(statements));
+}
+
+std::pair<std::vector<VarDef>, std::vector<Rule>> parse(
+    Generator<std::vector<lexer::Token>> lines) {
+    return splitStatements(parseStatements(std::move(lines)));
+}
+}  // namespace parser
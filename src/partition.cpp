@@ -0,0 +1,166 @@
+#include "partition.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace partition {
+
+using rule_dep::NodeId;
+
+/**
+ * @brief Replaces recipe-less goals by their prerequisites, transitively,
+ * keeping the first occurrence of every goal.
+ */
+static std::vector<NodeId> expandAggregates(
+    const rule_dep::Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules,
+    std::span<const NodeId> goals) {
+    std::vector<bool> seen(graph.numNodes(), false);
+    std::vector<NodeId> result;
+    std::vector<NodeId> stack(goals.rbegin(), goals.rend());
+    while (!stack.empty()) {
+        NodeId node = stack.back();
+        stack.pop_back();
+        if (seen[node]) {
+            continue;
+        }
+        seen[node] = true;
+        auto rule = graph.ruleOf(node);
+        if (rule.has_value() && rules[*rule]->recipes.empty()) {
+            auto prereqs = graph.prereqs(node);
+            stack.insert(stack.end(), prereqs.rbegin(), prereqs.rend());
+        } else {
+            result.emplace_back(node);
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Rule of `node` if it does work, i.e. has a recipe.
+ */
+static std::optional<size_t> workOf(
+    const rule_dep::Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules,
+    NodeId node) {
+    auto rule = graph.ruleOf(node);
+    if (rule.has_value() && rules[*rule]->recipes.empty()) {
+        return {};
+    }
+    return rule;
+}
+
+/**
+ * @brief Walks the prerequisite closure of `goal`, calling `visit(node)` for
+ * every node; the walk doesn't continue below nodes for which it returns
+ * false. `visitedBy` holds the last walk visiting each node, `walk` must be
+ * new.
+ */
+template <typename Visit>
+static void walkClosure(const rule_dep::Graph& graph, NodeId goal,
+                        uint32_t walk, std::vector<uint32_t>& visitedBy,
+                        std::vector<NodeId>& stack, Visit&& visit) {
+    stack.assign(1, goal);
+    visitedBy[goal] = walk;
+    while (!stack.empty()) {
+        NodeId node = stack.back();
+        stack.pop_back();
+        if (!visit(node)) {
+            continue;
+        }
+        for (NodeId p : graph.prereqs(node)) {
+            if (visitedBy[p] != walk) {
+                visitedBy[p] = walk;
+                stack.emplace_back(p);
+            }
+        }
+    }
+}
+
+Partition partitionGoals(
+    const rule_dep::Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules,
+    std::span<const NodeId> goals, size_t numShards) {
+    std::vector<NodeId> units = expandAggregates(graph, rules, goals);
+
+    // Walk 2i sizes the closure of unit i, walk 2i+1 assigns it.
+    std::vector<uint32_t> visitedBy(graph.numNodes(), UINT32_MAX);
+    std::vector<NodeId> stack;
+    std::vector<size_t> closureSize(units.size(), 0);
+    for (size_t i = 0; i < units.size(); i++) {
+        walkClosure(graph, units[i], 2 * i, visitedBy, stack,
+                    [&](NodeId node) {
+                        closureSize[i] += workOf(graph, rules, node) ? 1 : 0;
+                        return true;
+                    });
+    }
+    std::vector<size_t> order(units.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return closureSize[a] > closureSize[b];
+    });
+
+    Partition result;
+    result.ownerOf.assign(rules.size(), Partition::NO_SHARD);
+    std::vector<std::vector<size_t>> assigned(numShards);
+    std::vector<size_t> load(numShards, 0);
+    std::vector<size_t> edgesTo(numShards, 0);
+    std::vector<size_t> added;
+    for (size_t i : order) {
+        added.clear();
+        std::fill(edgesTo.begin(), edgesTo.end(), 0);
+        size_t edges = 0;
+        walkClosure(graph, units[i], 2 * i + 1, visitedBy, stack,
+                    [&](NodeId node) {
+                        auto rule = workOf(graph, rules, node);
+                        if (!rule.has_value()) {
+                            return true;
+                        }
+                        uint32_t owner = result.ownerOf[*rule];
+                        if (owner == Partition::NO_SHARD) {
+                            // `numShards` until assigned, so that a rule of
+                            // several targets is only added once.
+                            result.ownerOf[*rule] =
+                                static_cast<uint32_t>(numShards);
+                            added.emplace_back(*rule);
+                            return true;
+                        }
+                        if (owner < numShards) {
+                            edgesTo[owner]++;
+                            edges++;
+                        }
+                        return false;
+                    });
+        size_t best = 0;
+        size_t bestCost = SIZE_MAX;
+        for (size_t s = 0; s < numShards; s++) {
+            size_t cost = load[s] + added.size() + edges - edgesTo[s];
+            if (cost < bestCost) {
+                best = s;
+                bestCost = cost;
+            }
+        }
+        for (size_t rule : added) {
+            result.ownerOf[rule] = static_cast<uint32_t>(best);
+        }
+        load[best] += added.size();
+        assigned[best].emplace_back(i);
+    }
+    // Keep goals in their original order within a shard.
+    result.goals.resize(numShards);
+    for (size_t s = 0; s < numShards; s++) {
+        std::sort(assigned[s].begin(), assigned[s].end());
+        for (size_t i : assigned[s]) {
+            result.goals[s].emplace_back(units[i]);
+        }
+    }
+    return result;
+}
+}  // namespace partition
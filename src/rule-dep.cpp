@@ -0,0 +1,315 @@
+#include "rule-dep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace rule_dep {
+
+/**
+ * @brief Builds CSR arrays from an edge list, with duplicate edges removed.
+ */
+static void buildCsr(size_t numNodes,
+                     const std::vector<std::pair<NodeId, NodeId>>& edges,
+                     std::vector<size_t>& offsets, std::vector<NodeId>& adj) {
+    offsets.assign(numNodes + 1, 0);
+    for (const auto& [from, to] : edges) {
+        offsets[from + 1]++;
+    }
+    for (size_t i = 0; i < numNodes; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    adj.resize(edges.size());
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (const auto& [from, to] : edges) {
+        adj[cursor[from]++] = to;
+    }
+
+    size_t write = 0;
+    for (size_t i = 0; i < numNodes; i++) {
+        auto begin = adj.begin() + offsets[i];
+        auto end = adj.begin() + offsets[i + 1];
+        std::sort(begin, end);
+        end = std::unique(begin, end);
+        offsets[i] = write;
+        write = std::move(begin, end, adj.begin() + write) - adj.begin();
+    }
+    offsets[numNodes] = write;
+    adj.resize(write);
+}
+
+Graph::Graph(
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules) {
+    auto idOf = [this](const std::string& name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        if (names.size() > UINT32_MAX) {
+            throw RuleDepException({"too many nodes in the graph"});
+        }
+        it = ids.emplace(name, names.size()).first;
+        names.emplace_back(&it->first);
+        producers.emplace_back(NO_RULE);
+        return it->second;
+    };
+
+    std::vector<std::pair<NodeId, NodeId>> edges;
+    for (size_t i = 0; i < rules.size(); i++) {
+        const auto& rule = *rules[i];
+        for (const auto& t : rule.targets) {
+            NodeId target = idOf(t);
+            if (producers[target] == NO_RULE || !rule.recipes.empty()) {
+                producers[target] = i;
+            }
+            for (const auto& p : rule.prereqs) {
+                edges.emplace_back(target, idOf(p));
+            }
+        }
+    }
+    buildCsr(names.size(), edges, prereqOffsets, prereqEdges);
+    for (auto& [from, to] : edges) {
+        std::swap(from, to);
+    }
+    buildCsr(names.size(), edges, dependentOffsets, dependentEdges);
+}
+
+std::optional<NodeId> Graph::find(std::string_view name) const {
+    auto it = ids.find(std::string(name));
+    if (it == ids.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+std::optional<size_t> Graph::ruleOf(NodeId node) const {
+    if (producers[node] == NO_RULE) {
+        return {};
+    }
+    return producers[node];
+}
+
+std::vector<NodeId> reverseReachable(const Graph& graph,
+                                     std::span<const NodeId> seeds,
+                                     thread_pool::ThreadPool& pool) {
+    // Below this frontier size, handing work to the pool costs more than it
+    // saves.
+    constexpr size_t PARALLEL_THRESHOLD = 1 << 12;
+
+    std::vector<std::atomic<uint8_t>> visited(graph.numNodes());
+    auto visit = [&visited](NodeId node) {
+        return visited[node].exchange(1, std::memory_order_relaxed) == 0;
+    };
+    auto expand = [&graph, &visit](std::span<const NodeId> frontier) {
+        std::vector<NodeId> next;
+        for (NodeId node : frontier) {
+            for (NodeId d : graph.dependents(node)) {
+                if (visit(d)) {
+                    next.emplace_back(d);
+                }
+            }
+        }
+        return next;
+    };
+
+    std::vector<NodeId> frontier;
+    for (NodeId s : seeds) {
+        if (visit(s)) {
+            frontier.emplace_back(s);
+        }
+    }
+    while (!frontier.empty()) {
+        if (frontier.size() < PARALLEL_THRESHOLD || pool.size() == 1) {
+            frontier = expand(frontier);
+            continue;
+        }
+        size_t numChunks = pool.size() * 4;
+        size_t chunkSize = (frontier.size() + numChunks - 1) / numChunks;
+        std::vector<std::future<std::vector<NodeId>>> chunks;
+        for (size_t begin = 0; begin < frontier.size(); begin += chunkSize) {
+            std::span<const NodeId> chunk(frontier);
+            chunk = chunk.subspan(begin,
+                                  std::min(chunkSize, frontier.size() - begin));
+            chunks.emplace_back(pool.submit([&expand, chunk] {
+                return expand(chunk);
+            }));
+        }
+        std::vector<NodeId> next;
+        for (auto& c : chunks) {
+            auto part = c.get();
+            next.insert(next.end(), part.begin(), part.end());
+        }
+        frontier = std::move(next);
+    }
+
+    std::vector<NodeId> result;
+    for (size_t i = 0; i < visited.size(); i++) {
+        if (visited[i].load(std::memory_order_relaxed)) {
+            result.emplace_back(i);
+        }
+    }
+    return result;
+}
+
+std::vector<std::vector<NodeId>> stronglyConnectedComponents(
+    const Graph& graph) {
+    constexpr uint32_t UNVISITED = UINT32_MAX;
+    const size_t numNodes = graph.numNodes();
+    std::vector<uint32_t> index(numNodes, UNVISITED);
+    std::vector<uint32_t> lowlink(numNodes);
+    std::vector<bool> onStack(numNodes, false);
+    std::vector<NodeId> stack;
+    // Explicit call stack of (node, next prerequisite to visit).
+    std::vector<std::pair<NodeId, uint32_t>> callStack;
+    std::vector<std::vector<NodeId>> components;
+    uint32_t nextIndex = 0;
+
+    auto enter = [&](NodeId node) {
+        index[node] = lowlink[node] = nextIndex++;
+        stack.emplace_back(node);
+        onStack[node] = true;
+        callStack.emplace_back(node, 0);
+    };
+
+    for (NodeId root = 0; root < numNodes; root++) {
+        if (index[root] != UNVISITED) {
+            continue;
+        }
+        enter(root);
+        while (!callStack.empty()) {
+            auto [node, nextEdge] = callStack.back();
+            auto prereqs = graph.prereqs(node);
+            if (nextEdge < prereqs.size()) {
+                callStack.back().second++;
+                NodeId p = prereqs[nextEdge];
+                if (index[p] == UNVISITED) {
+                    enter(p);
+                } else if (onStack[p]) {
+                    lowlink[node] = std::min(lowlink[node], index[p]);
+                }
+                continue;
+            }
+
+            callStack.pop_back();
+            if (!callStack.empty()) {
+                NodeId parent = callStack.back().first;
+                lowlink[parent] = std::min(lowlink[parent], lowlink[node]);
+            }
+            if (lowlink[node] == index[node]) {
+                std::vector<NodeId> component;
+                NodeId member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    component.emplace_back(member);
+                } while (member != node);
+                components.emplace_back(std::move(component));
+            }
+        }
+    }
+    return components;
+}
+
+/**
+ * @brief Shortest cycle through `start` that stays inside its component.
+ */
+static std::vector<NodeId> cycleThrough(
+    const Graph& graph, NodeId start, const std::vector<NodeId>& component,
+    const std::vector<uint32_t>& componentOf, uint32_t componentId) {
+    std::unordered_map<NodeId, NodeId> parent{{start, start}};
+    std::vector<NodeId> frontier{start};
+    for (size_t i = 0; i < frontier.size(); i++) {
+        NodeId node = frontier[i];
+        for (NodeId p : graph.prereqs(node)) {
+            if (p == start) {
+                std::vector<NodeId> path{start};
+                for (NodeId n = node; n != start; n = parent.at(n)) {
+                    path.emplace_back(n);
+                }
+                std::reverse(path.begin() + 1, path.end());
+                return path;
+            }
+            if (componentOf[p] == componentId && !parent.contains(p)) {
+                parent.emplace(p, node);
+                frontier.emplace_back(p);
+            }
+        }
+    }
+    return component;  // Unreachable for a cyclic component.
+}
+
+Levelization levelize(
+    const Graph& graph,
+    const std::vector<std::shared_ptr<auto_var_replacement::Rule>>& rules) {
+    auto components = stronglyConnectedComponents(graph);
+
+    constexpr uint32_t ACYCLIC = UINT32_MAX;
+    std::vector<uint32_t> componentOf(graph.numNodes(), ACYCLIC);
+    std::vector<std::string> cycles;
+    for (uint32_t c = 0; c < components.size(); c++) {
+        const auto& component = components[c];
+        NodeId first = component.front();
+        auto prereqs = graph.prereqs(first);
+        bool selfLoop =
+            std::find(prereqs.begin(), prereqs.end(), first) != prereqs.end();
+        if (component.size() == 1 && !selfLoop) {
+            continue;
+        }
+        for (NodeId n : component) {
+            componentOf[n] = c;
+        }
+        std::string description;
+        auto path = cycleThrough(graph, first, component, componentOf, c);
+        path.emplace_back(first);
+        for (NodeId n : path) {
+            if (!description.empty()) {
+                description += " -> ";
+            }
+            description += graph.name(n);
+            auto rule = graph.ruleOf(n);
+            if (rule.has_value()) {
+                description +=
+                    " (line " + std::to_string(rules[*rule]->lineno) + ")";
+            }
+        }
+        cycles.emplace_back(std::move(description));
+    }
+    if (!cycles.empty()) {
+        std::vector<std::string> whatArgs{
+            "Circular dependencies found (" + std::to_string(cycles.size()) +
+            "):"};
+        for (auto& c : cycles) {
+            whatArgs.emplace_back("\n\t" + c);
+        }
+        throw RuleDepException(whatArgs);
+    }
+
+    // Acyclic: components are single nodes, prerequisites first.
+    Levelization result;
+    result.levelOf.assign(graph.numNodes(), 0);
+    for (const auto& component : components) {
+        NodeId node = component.front();
+        uint32_t level = 0;
+        for (NodeId p : graph.prereqs(node)) {
+            level = std::max(level, result.levelOf[p] + 1);
+        }
+        result.levelOf[node] = level;
+        if (level >= result.levels.size()) {
+            result.levels.resize(level + 1);
+        }
+        result.levels[level].emplace_back(node);
+    }
+    return result;
+}
+}  // namespace rule_dep
@@ -0,0 +1,101 @@
+#include "rule-filter.h"
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "rule-dep.h"
+
+namespace rule_filter {
+
+using rule_dep::NodeId;
+
+static std::vector<bool> closure(const rule_dep::Graph& graph,
+                                 std::span<const NodeId> goals) {
+    std::vector<bool> needed(graph.numNodes(), false);
+    std::vector<NodeId> stack;
+    for (NodeId g : goals) {
+        if (!needed[g]) {
+            needed[g] = true;
+            stack.emplace_back(g);
+        }
+    }
+    while (!stack.empty()) {
+        NodeId node = stack.back();
+        stack.pop_back();
+        for (NodeId p : graph.prereqs(node)) {
+            if (!needed[p]) {
+                needed[p] = true;
+                stack.emplace_back(p);
+            }
+        }
+    }
+    return needed;
+}
+
+std::optional<std::filesystem::file_time_type> MtimeTable::get(
+    const rule_dep::Graph& graph, NodeId node) {
+    Entry& entry = entries[node];
+    if (!entry.known) {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(graph.name(node), ec);
+        entry.mtime = ec ? std::nullopt : std::make_optional(mtime);
+        entry.known = entry.watched;
+        numStatCalls++;
+    }
+    return entry.mtime;
+}
+
+std::vector<bool> filter(const rule_dep::Graph& graph,
+                         const rule_dep::Levelization& levelization,
+                         std::span<const NodeId> goals) {
+    MtimeTable mtimes(graph.numNodes());
+    return filter(graph, levelization, goals, mtimes);
+}
+
+std::vector<bool> filter(const rule_dep::Graph& graph,
+                         const rule_dep::Levelization& levelization,
+                         std::span<const NodeId> goals, MtimeTable& mtimes) {
+    std::vector<bool> needed = closure(graph, goals);
+    // Prerequisites are on lower levels, so theirs are always set here first.
+    std::vector<std::optional<std::filesystem::file_time_type>> mtimeOf(
+        graph.numNodes());
+    std::vector<bool> outOfDate(graph.numNodes(), false);
+
+    for (const auto& level : levelization.levels) {
+        for (NodeId node : level) {
+            if (!needed[node]) {
+                continue;
+            }
+            mtimeOf[node] = mtimes.get(graph, node);
+            if (!graph.ruleOf(node).has_value()) {
+                if (mtimeOf[node].has_value()) {
+                    continue;
+                }
+                std::vector<std::string> whatArgs{"No rule to make target",
+                                                  graph.name(node)};
+                for (NodeId d : graph.dependents(node)) {
+                    if (needed[d]) {
+                        whatArgs.emplace_back(", needed by " + graph.name(d));
+                        break;
+                    }
+                }
+                throw RuleFilterException(whatArgs);
+            }
+
+            bool stale = !mtimeOf[node].has_value();
+            for (NodeId p : graph.prereqs(node)) {
+                if (stale) {
+                    break;
+                }
+                stale = outOfDate[p] || mtimeOf[p] > mtimeOf[node];
+            }
+            outOfDate[node] = stale;
+        }
+    }
+    return outOfDate;
+}
+}  // namespace rule_filter
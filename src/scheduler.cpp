@@ -0,0 +1,344 @@
+#include "scheduler.h"
+
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+
+namespace scheduler {
+
+using Rule = auto_var_replacement::Rule;
+
+static constexpr std::chrono::milliseconds AWAIT_POLL_INTERVAL(50);
+
+/**
+ * @brief Runs `command` with `sh`, returning its exit status and combined
+ * stdout/stderr.
+ */
+static std::pair<int, std::string> runCommand(const std::string& command) {
+    // The newline ends a trailing comment in `command` before the brace.
+    std::string wrapped("export ");
+    wrapped += IN_RECIPE_VARIABLE;
+    wrapped += "=1\n{ " + command + "\n} 2>&1";
+    FILE* pipe = ::popen(wrapped.c_str(), "r");
+    if (pipe == nullptr) {
+        throw SchedulerException({"can't start shell for:", command});
+    }
+    std::string output;
+    std::array<char, 4096> buffer;
+    size_t n;
+    while ((n = std::fread(buffer.data(), 1, buffer.size(), pipe)) > 0) {
+        output.append(buffer.data(), n);
+    }
+    int status = ::pclose(pipe);
+    if (status != -1 && WIFEXITED(status)) {
+        status = WEXITSTATUS(status);
+    }
+    return {status, output};
+}
+
+/**
+ * @brief Restores the targets of `rule` from `cache`, logging them to `out`.
+ *
+ * @param key Set to the action key of `rule` if it isn't cached.
+ */
+static bool restoreRule(const Rule& rule,
+                        const action_cache::ActionCache* cache,
+                        std::string& key, std::ostream& out,
+                        std::mutex& outMutex) {
+    if (cache == nullptr) {
+        return false;
+    }
+    key = cache->actionKey(rule);
+    if (!cache->restore(key)) {
+        return false;
+    }
+    std::lock_guard lock(outMutex);
+    for (const auto& t : rule.targets) {
+        out << "restored from cache: " << t << '\n';
+    }
+    out.flush();
+    return true;
+}
+
+/**
+ * @brief Runs (or restores) one rule, writing its log to `out` under
+ * `outMutex`.
+ */
+static void runRule(const Rule& rule, const action_cache::ActionCache* cache,
+                    std::ostream& out, std::mutex& outMutex) {
+    std::string key;
+    if (restoreRule(rule, cache, key, out, outMutex)) {
+        return;
+    }
+    for (const auto& recipe : rule.recipes) {
+        auto [status, output] = runCommand(recipe);
+        {
+            std::lock_guard lock(outMutex);
+            out << recipe << '\n' << output;
+            out.flush();
+        }
+        if (status != 0) {
+            throw SchedulerException(
+                {"recipe for target", rule.targets.front(), "at line",
+                 std::to_string(rule.lineno), "failed with exit status",
+                 std::to_string(status)});
+        }
+    }
+    if (cache != nullptr) {
+        cache->store(key, rule.targets);
+    }
+}
+
+/**
+ * @brief Runs the rules of `batch`, which share their recipe template, with
+ * one command. Rules restored from `cache` are left out of it.
+ */
+static void runBatch(const std::vector<const Rule*>& batch,
+                     const action_cache::ActionCache* cache,
+                     std::ostream& out, std::mutex& outMutex) {
+    if (batch.size() == 1) {
+        runRule(*batch.front(), cache, out, outMutex);
+        return;
+    }
+    std::vector<const Rule*> toRun;
+    std::vector<std::string> keys;
+    for (const Rule* rule : batch) {
+        std::string key;
+        if (!restoreRule(*rule, cache, key, out, outMutex)) {
+            toRun.emplace_back(rule);
+            keys.emplace_back(std::move(key));
+        }
+    }
+    if (toRun.empty()) {
+        return;
+    }
+    std::string command = batch::combinedCommand(toRun);
+    auto [status, output] = runCommand(command);
+    {
+        std::lock_guard lock(outMutex);
+        out << command << '\n' << output;
+        out.flush();
+    }
+    if (status != 0) {
+        throw SchedulerException(
+            {"batched recipe for", std::to_string(toRun.size()),
+             "targets from", toRun.front()->targets.front(), "at line",
+             std::to_string(toRun.front()->lineno), "failed with exit status",
+             std::to_string(status)});
+    }
+    if (cache != nullptr) {
+        for (size_t i = 0; i < toRun.size(); i++) {
+            cache->store(keys[i], toRun[i]->targets);
+        }
+    }
+}
+
+/**
+ * @brief Whether every target of `rule` exists and is no older than its
+ * prerequisites, i.e. whoever builds it is done.
+ */
+static bool isBuilt(const Rule& rule) {
+    std::error_code ec;
+    std::optional<std::filesystem::file_time_type> newestPrereq;
+    for (const auto& p : rule.prereqs) {
+        auto mtime = std::filesystem::last_write_time(p, ec);
+        if (!ec && (!newestPrereq.has_value() || mtime > *newestPrereq)) {
+            newestPrereq = mtime;
+        }
+    }
+    for (const auto& t : rule.targets) {
+        auto mtime = std::filesystem::last_write_time(t, ec);
+        if (ec || (newestPrereq.has_value() && *newestPrereq > mtime)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t execute(const rule_dep::Graph& graph,
+               const std::vector<std::shared_ptr<Rule>>& rules,
+               const std::vector<bool>& outOfDate,
+               thread_pool::ThreadPool& pool, size_t maxJobs,
+               const action_cache::ActionCache* cache, std::ostream& out,
+               const std::vector<bool>& batchable, size_t maxBatchSize,
+               const std::vector<bool>& awaited,
+               std::chrono::seconds awaitTimeout) {
+    // One job per rule, even if several of its targets are out of date.
+    std::unordered_map<size_t, size_t> jobOfRule;
+    std::vector<size_t> jobRules;
+    auto jobOf = [&](rule_dep::NodeId node) {
+        size_t rule = graph.ruleOf(node).value();
+        auto [it, inserted] = jobOfRule.try_emplace(rule, jobRules.size());
+        if (inserted) {
+            jobRules.emplace_back(rule);
+        }
+        return it->second;
+    };
+    std::vector<std::pair<size_t, size_t>> edges;
+    for (rule_dep::NodeId node = 0; node < graph.numNodes(); node++) {
+        if (!outOfDate[node]) {
+            continue;
+        }
+        size_t job = jobOf(node);
+        for (rule_dep::NodeId p : graph.prereqs(node)) {
+            if (outOfDate[p] && jobOf(p) != job) {
+                edges.emplace_back(jobOf(p), job);
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    std::vector<std::vector<size_t>> dependents(jobRules.size());
+    std::vector<size_t> pending(jobRules.size(), 0);
+    for (const auto& [from, to] : edges) {
+        dependents[from].emplace_back(to);
+        pending[to]++;
+    }
+
+    std::vector<size_t> ready;
+    // Ready batchable jobs by recipe template. They are held back while every
+    // worker is busy, so that a batch collects the jobs becoming ready in the
+    // meantime.
+    std::map<std::string_view, std::vector<size_t>> readyBatches;
+    // Ready awaited jobs and when they became ready.
+    std::vector<std::pair<size_t, std::chrono::steady_clock::time_point>>
+        awaiting;
+    auto makeReady = [&](size_t job) {
+        size_t rule = jobRules[job];
+        if (rule < awaited.size() && awaited[rule]) {
+            awaiting.emplace_back(job, std::chrono::steady_clock::now());
+        } else if (maxBatchSize > 1 && rule < batchable.size() &&
+                   batchable[rule]) {
+            readyBatches[rules[rule]->recipeTemplate].emplace_back(job);
+        } else {
+            ready.emplace_back(job);
+        }
+    };
+    for (size_t job = 0; job < jobRules.size(); job++) {
+        if (pending[job] == 0) {
+            makeReady(job);
+        }
+    }
+
+    std::mutex outMutex;
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    std::deque<std::pair<std::vector<size_t>, std::exception_ptr>> done;
+    size_t inFlight = 0;
+    size_t finished = 0;
+    std::exception_ptr failure;
+    auto submit = [&](std::vector<size_t> jobs) {
+        std::vector<const Rule*> batch;
+        for (size_t job : jobs) {
+            batch.emplace_back(rules[jobRules[job]].get());
+        }
+        pool.submit([&, jobs = std::move(jobs), batch = std::move(batch)] {
+            std::exception_ptr error;
+            try {
+                runBatch(batch, cache, out, outMutex);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            // Notify under the lock: once it is released, `execute` may
+            // return and destroy `doneCv`.
+            std::lock_guard lock(doneMutex);
+            done.emplace_back(std::move(jobs), error);
+            doneCv.notify_one();
+        });
+        inFlight++;
+    };
+    size_t maxInFlight = std::max<size_t>(1, std::min(maxJobs, pool.size()));
+    while (true) {
+        while (!failure && !ready.empty() && inFlight < maxInFlight) {
+            size_t job = ready.back();
+            ready.pop_back();
+            submit({job});
+        }
+        while (!failure && !readyBatches.empty() && inFlight < maxInFlight) {
+            auto jobs = std::move(readyBatches.begin()->second);
+            readyBatches.erase(readyBatches.begin());
+            // Evenly sized batches, so that they finish at about the same
+            // time.
+            size_t numBatches = (jobs.size() + maxBatchSize - 1) / maxBatchSize;
+            for (size_t b = 0; b < numBatches; b++) {
+                submit(std::vector<size_t>(
+                    jobs.begin() + jobs.size() * b / numBatches,
+                    jobs.begin() + jobs.size() * (b + 1) / numBatches));
+            }
+        }
+        if (inFlight == 0 && (failure || awaiting.empty())) {
+            break;
+        }
+
+        std::unique_lock lock(doneMutex);
+        if (awaiting.empty()) {
+            doneCv.wait(lock, [&done] { return !done.empty(); });
+        } else {
+            doneCv.wait_for(lock, AWAIT_POLL_INTERVAL,
+                            [&done] { return !done.empty(); });
+        }
+        auto completed = std::move(done);
+        done.clear();
+        lock.unlock();
+        std::vector<size_t> finishedJobs;
+        for (auto& [jobs, error] : completed) {
+            inFlight--;
+            if (error) {
+                failure = failure ? failure : error;
+                continue;
+            }
+            finished += jobs.size();
+            finishedJobs.insert(finishedJobs.end(), jobs.begin(), jobs.end());
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; !failure && i < awaiting.size();) {
+            auto [job, since] = awaiting[i];
+            const Rule& rule = *rules[jobRules[job]];
+            if (isBuilt(rule)) {
+                finishedJobs.emplace_back(job);
+                awaiting[i] = awaiting.back();
+                awaiting.pop_back();
+            } else if (now - since > awaitTimeout) {
+                failure = std::make_exception_ptr(SchedulerException(
+                    {"timed out waiting for target", rule.targets.front(),
+                     "at line", std::to_string(rule.lineno),
+                     "to be built by another shard"}));
+            } else {
+                i++;
+            }
+        }
+        for (size_t job : finishedJobs) {
+            for (size_t d : dependents[job]) {
+                if (--pending[d] == 0) {
+                    makeReady(d);
+                }
+            }
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    return finished;
+}
+}  // namespace scheduler
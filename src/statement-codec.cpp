@@ -0,0 +1,299 @@
+#include "statement-codec.h"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+
+namespace statement_codec {
+
+// Numbers are written in decimal followed by a space, strings as their
+// length followed by their bytes, and every token or statement starts with a
+// one-character tag.
+
+static void putNumber(std::string& out, uint64_t n) {
+    out += std::to_string(n);
+    out += ' ';
+}
+
+static void putString(std::string& out, std::string_view s) {
+    putNumber(out, s.size());
+    out += s;
+}
+
+static void putToken(std::string& out, const lexer::Word& word) {
+    out += 'W';
+    putString(out, word.name);
+    putNumber(out, word.lineno);
+    putNumber(out, word.joined);
+}
+
+static void putToken(std::string& out, const lexer::Var& var) {
+    out += 'V';
+    putString(out, var.name);
+    putNumber(out, var.lineno);
+    putNumber(out, var.joined);
+}
+
+static void putToken(std::string& out, const lexer::AutoVar& autoVar) {
+    out += 'A';
+    putNumber(out, autoVar.type);
+    putNumber(out, autoVar.lineno);
+    putNumber(out, autoVar.joined);
+}
+
+static void putToken(std::string& out, const lexer::String& str) {
+    out += 'S';
+    putNumber(out, str.lineno);
+    putNumber(out, str.joined);
+    putNumber(out, str.segments.size());
+    for (const auto& seg : str.segments) {
+        if (std::holds_alternative<std::string>(seg)) {
+            out += 's';
+            putString(out, std::get<std::string>(seg));
+        } else if (std::holds_alternative<lexer::Var>(seg)) {
+            putToken(out, std::get<lexer::Var>(seg));
+        } else if (std::holds_alternative<lexer::AutoVar>(seg)) {
+            putToken(out, std::get<lexer::AutoVar>(seg));
+        } else {
+            out += 'D';
+        }
+    }
+}
+
+template <typename... Alternatives>
+static void putToken(std::string& out,
+                     const std::variant<Alternatives...>& token) {
+    std::visit([&out](const auto& t) { putToken(out, t); }, token);
+}
+
+template <typename T>
+static void putTokens(std::string& out, const std::vector<T>& tokens) {
+    putNumber(out, tokens.size());
+    for (const auto& t : tokens) {
+        putToken(out, t);
+    }
+}
+
+std::string encode(const std::vector<parser::Statement>& statements) {
+    std::string out;
+    putNumber(out, statements.size());
+    for (const auto& s : statements) {
+        if (std::holds_alternative<parser::VarDef>(s)) {
+            const auto& varDef = std::get<parser::VarDef>(s);
+            out += 'd';
+            putToken(out, varDef.varName);
+            putTokens(out, varDef.values);
+        } else if (std::holds_alternative<parser::Rule>(s)) {
+            const auto& rule = std::get<parser::Rule>(s);
+            out += 'r';
+            putTokens(out, rule.targets);
+            putTokens(out, rule.prereqs);
+            putNumber(out, rule.recipes.size());
+            for (const auto& recipe : rule.recipes) {
+                putTokens(out, recipe);
+            }
+        } else {
+            const auto& include = std::get<parser::Include>(s);
+            out += 'i';
+            putNumber(out, include.optional);
+            putNumber(out, include.lineno);
+            putTokens(out, include.paths);
+        }
+    }
+    return out;
+}
+
+class Reader {
+   public:
+    explicit Reader(std::string_view data_) : data(data_) {}
+
+    bool done() const { return data.empty(); }
+
+    char tag() {
+        if (data.empty()) {
+            throw corrupted();
+        }
+        char c = data.front();
+        data.remove_prefix(1);
+        return c;
+    }
+
+    uint64_t number() {
+        uint64_t n = 0;
+        const char* last = data.data() + data.size();
+        auto [end, ec] = std::from_chars(data.data(), last, n);
+        if (ec != std::errc() || end == last || *end != ' ') {
+            throw corrupted();
+        }
+        data.remove_prefix(end - data.data() + 1);
+        return n;
+    }
+
+    std::string string() {
+        uint64_t size = number();
+        if (size > data.size()) {
+            throw corrupted();
+        }
+        std::string s(data.substr(0, size));
+        data.remove_prefix(size);
+        return s;
+    }
+
+    static CodecException corrupted() {
+        return CodecException({"corrupted statement data"});
+    }
+
+   private:
+    std::string_view data;
+};
+
+static lexer::Word getWord(Reader& in) {
+    std::string name = in.string();
+    size_t lineno = in.number();
+    lexer::Word word(name, lineno);
+    word.joined = in.number() != 0;
+    return word;
+}
+
+static lexer::Var getVar(Reader& in) {
+    std::string name = in.string();
+    size_t lineno = in.number();
+    lexer::Var var(name, lineno);
+    var.joined = in.number() != 0;
+    return var;
+}
+
+static lexer::AutoVar getAutoVar(Reader& in) {
+    uint64_t type = in.number();
+    if (type > lexer::AutoVar::DOLLAR_SUP) {
+        throw Reader::corrupted();
+    }
+    size_t lineno = in.number();
+    lexer::AutoVar autoVar(static_cast<lexer::AutoVar::Type>(type), lineno);
+    autoVar.joined = in.number() != 0;
+    return autoVar;
+}
+
+static lexer::String getString(Reader& in) {
+    size_t lineno = in.number();
+    bool joined = in.number() != 0;
+    uint64_t size = in.number();
+    std::vector<lexer::String::Segment> segments;
+    for (uint64_t i = 0; i < size; i++) {
+        switch (in.tag()) {
+            case 's':
+                segments.emplace_back(in.string());
+                break;
+            case 'V':
+                segments.emplace_back(getVar(in));
+                break;
+            case 'A':
+                segments.emplace_back(getAutoVar(in));
+                break;
+            case 'D':
+                segments.emplace_back(lexer::Dollar());
+                break;
+            default:
+                throw Reader::corrupted();
+        }
+    }
+    lexer::String str(segments, lineno);
+    str.joined = joined;
+    return str;
+}
+
+/**
+ * @brief Reads one token and returns it as a `T`, which is either a token
+ * kind or a variant of the kinds that may appear at this position.
+ */
+template <typename T>
+static T getToken(Reader& in) {
+    auto as = [](auto token) -> T {
+        if constexpr (std::is_constructible_v<T, decltype(token)>) {
+            return token;
+        } else {
+            throw Reader::corrupted();
+        }
+    };
+    switch (in.tag()) {
+        case 'W':
+            return as(getWord(in));
+        case 'V':
+            return as(getVar(in));
+        case 'A':
+            return as(getAutoVar(in));
+        case 'S':
+            return as(getString(in));
+        default:
+            throw Reader::corrupted();
+    }
+}
+
+template <typename T>
+static std::vector<T> getTokens(Reader& in) {
+    // Not reserved up front, a corrupted count must not allocate.
+    uint64_t size = in.number();
+    std::vector<T> tokens;
+    for (uint64_t i = 0; i < size; i++) {
+        tokens.emplace_back(getToken<T>(in));
+    }
+    return tokens;
+}
+
+std::vector<parser::Statement> decode(std::string_view data) {
+    Reader in(data);
+    uint64_t size = in.number();
+    std::vector<parser::Statement> statements;
+    for (uint64_t i = 0; i < size; i++) {
+        switch (in.tag()) {
+            case 'd': {
+                auto varName = getToken<lexer::Word>(in);
+                statements.emplace_back(parser::VarDef(
+                    varName,
+                    getTokens<std::variant<lexer::Word, lexer::Var>>(in)));
+                break;
+            }
+            case 'r': {
+                auto targets =
+                    getTokens<std::variant<lexer::Word, lexer::Var>>(in);
+                auto prereqs =
+                    getTokens<std::variant<lexer::Word, lexer::Var>>(in);
+                uint64_t numRecipes = in.number();
+                std::vector<std::vector<std::variant<
+                    lexer::Word, lexer::Var, lexer::AutoVar, lexer::String>>>
+                    recipes;
+                for (uint64_t j = 0; j < numRecipes; j++) {
+                    recipes.emplace_back(
+                        getTokens<std::variant<lexer::Word, lexer::Var,
+                                               lexer::AutoVar, lexer::String>>(
+                            in));
+                }
+                statements.emplace_back(
+                    parser::Rule(targets, prereqs, recipes));
+                break;
+            }
+            case 'i': {
+                bool optional = in.number() != 0;
+                size_t lineno = in.number();
+                statements.emplace_back(parser::Include(
+                    getTokens<lexer::Word>(in), optional, lineno));
+                break;
+            }
+            default:
+                throw Reader::corrupted();
+        }
+    }
+    if (!in.done()) {
+        throw Reader::corrupted();
+    }
+    return statements;
+}
+}  // namespace statement_codec
@@ -0,0 +1,162 @@
+#include "stats.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+
+#ifndef TINYMAKE_VERSION
+#define TINYMAKE_VERSION "unknown"
+#endif
+
+namespace stats {
+
+static std::atomic<bool> countingEnabled = false;
+static std::atomic<uint64_t> allocationCount = 0;
+static std::atomic<uint64_t> allocatedBytes = 0;
+static std::atomic<uint64_t> deallocationCount = 0;
+
+static void recordAllocation(size_t size) {
+    if (countingEnabled.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+static void recordDeallocation(void* ptr) {
+    if (ptr != nullptr && countingEnabled.load(std::memory_order_relaxed)) {
+        deallocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+AllocationCounting::AllocationCounting(bool enable)
+    : previous(countingEnabled) {
+    if (enable) {
+        countingEnabled = true;
+    }
+}
+
+AllocationCounting::~AllocationCounting() { countingEnabled = previous; }
+
+AllocationCounters allocationCounters() {
+    return {allocationCount.load(std::memory_order_relaxed),
+            allocatedBytes.load(std::memory_order_relaxed),
+            deallocationCount.load(std::memory_order_relaxed)};
+}
+
+uint64_t peakRssKib() {
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;  // Already in KiB on Linux.
+}
+
+Report::Scope::Scope(Report& report_, const std::string& name)
+    : report(report_),
+      start(std::chrono::steady_clock::now()),
+      startCounters(allocationCounters()) {
+    pass.name = name;
+}
+
+Report::Scope::~Scope() {
+    AllocationCounters end = allocationCounters();
+    pass.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    pass.allocations = {end.allocations - startCounters.allocations,
+                        end.bytes - startCounters.bytes,
+                        end.deallocations - startCounters.deallocations};
+    report.passes.emplace_back(std::move(pass));
+}
+
+void Report::Scope::setItems(uint64_t items, const std::string& unit) {
+    pass.items = items;
+    pass.itemUnit = unit;
+}
+
+static std::string number(double value) {
+    std::array<char, 32> buffer;
+    std::snprintf(buffer.data(), buffer.size(), "%.6g", value);
+    return buffer.data();
+}
+
+std::string Report::toJson() const {
+    std::string json = "{\"version\":\"" TINYMAKE_VERSION "\",";
+    json += "\"allocation_counting\":";
+    json += countingEnabled ? "true" : "false";
+    // Process-wide, not only this run's.
+    json += ",\"peak_rss_kib\":" + std::to_string(peakRssKib());
+    json += ",\"workers\":" + std::to_string(workers);
+    json += ",\"worker_utilization\":" + number(workerUtilization);
+    json += ",\"passes\":[";
+    for (size_t i = 0; i < passes.size(); i++) {
+        const auto& p = passes[i];
+        json += i == 0 ? "{" : ",{";
+        // Pass names and units are fixed identifiers, no escaping needed.
+        json += "\"name\":\"" + p.name + "\"";
+        json += ",\"seconds\":" + number(p.seconds);
+        json += ",\"allocations\":" + std::to_string(p.allocations.allocations);
+        json += ",\"allocated_bytes\":" + std::to_string(p.allocations.bytes);
+        json += ",\"deallocations\":" +
+                std::to_string(p.allocations.deallocations);
+        if (!p.itemUnit.empty()) {
+            json += ",\"" + p.itemUnit + "\":" + std::to_string(p.items);
+            json += ",\"" + p.itemUnit + "_per_second\":" +
+                    number(p.seconds > 0 ? p.items / p.seconds : 0);
+        }
+        json += "}";
+    }
+    json += "]}";
+    return json;
+}
+}  // namespace stats
+
+// Global allocation hooks. The array and nothrow forms are implemented by the
+// standard library in terms of these.
+
+void* operator new(size_t size) {
+    stats::recordAllocation(size);
+    if (size == 0) {
+        size = 1;
+    }
+    void* ptr = std::malloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    stats::recordAllocation(size);
+    size_t align = static_cast<size_t>(alignment);
+    // `aligned_alloc` wants a size that is a multiple of the alignment.
+    size_t rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+    void* ptr = std::aligned_alloc(align, rounded);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    stats::recordDeallocation(ptr);
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    stats::recordDeallocation(ptr);
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
@@ -0,0 +1,50 @@
+#include "thread-pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace thread_pool {
+
+ThreadPool::ThreadPool(size_t numThreads) {
+    numThreads = std::max<size_t>(numThreads, 1);
+    workers.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; i++) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        auto start = std::chrono::steady_clock::now();
+        task();
+        busyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    }
+}
+}  // namespace thread_pool
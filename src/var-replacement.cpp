@@ -0,0 +1,99 @@
+#include "var-replacement.h"
+
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+
+namespace var_replacement {
+
+static const std::vector<std::string>& lookup(const std::string& name,
+                                              const Variables& variables) {
+    static const std::vector<std::string> empty;
+    auto it = variables.find(name);
+    return it == variables.end() ? empty : it->second;
+}
+
+static std::vector<std::string> expandWords(
+    const std::vector<std::variant<lexer::Word, lexer::Var>>& words,
+    const Variables& variables) {
+    WordBuilder<std::string> result;
+    for (const auto& w : words) {
+        if (std::holds_alternative<lexer::Word>(w)) {
+            const auto& word = std::get<lexer::Word>(w);
+            result.beginToken(word.joined);
+            result.add(word.name);
+        } else {
+            const auto& var = std::get<lexer::Var>(w);
+            result.beginToken(var.joined);
+            for (const auto& value : lookup(var.name, variables)) {
+                result.add(value);
+            }
+        }
+    }
+    return result.take();
+}
+
+static std::string join(const std::vector<std::string>& words) {
+    std::string result;
+    for (const auto& w : words) {
+        if (!result.empty()) {
+            result += ' ';
+        }
+        result += w;
+    }
+    return result;
+}
+
+static String expandString(const lexer::String& str,
+                           const Variables& variables) {
+    std::vector<String::Segment> segments;
+    for (const auto& seg : str.segments) {
+        if (std::holds_alternative<std::string>(seg)) {
+            segments.emplace_back(std::get<std::string>(seg));
+        } else if (std::holds_alternative<lexer::Var>(seg)) {
+            segments.emplace_back(
+                join(lookup(std::get<lexer::Var>(seg).name, variables)));
+        } else if (std::holds_alternative<lexer::AutoVar>(seg)) {
+            segments.emplace_back(std::get<lexer::AutoVar>(seg));
+        } else {
+            segments.emplace_back(std::get<lexer::Dollar>(seg));
+        }
+    }
+    return String(segments);
+}
+
+std::shared_ptr<Rule> replace(const std::shared_ptr<parser::Rule>& rule,
+                              const Variables& variables) {
+    std::vector<Rule::Recipe> recipes;
+    for (const auto& line : rule->recipes) {
+        WordBuilder<Rule::Word> recipe;
+        for (const auto& r : line) {
+            recipe.beginToken(
+                std::visit([](const auto& t) { return t.joined; }, r));
+            if (std::holds_alternative<lexer::Word>(r)) {
+                recipe.add(std::get<lexer::Word>(r).name);
+            } else if (std::holds_alternative<lexer::Var>(r)) {
+                for (const auto& value :
+                     lookup(std::get<lexer::Var>(r).name, variables)) {
+                    recipe.add(value);
+                }
+            } else if (std::holds_alternative<lexer::AutoVar>(r)) {
+                recipe.add(std::get<lexer::AutoVar>(r));
+            } else {
+                recipe.add(
+                    expandString(std::get<lexer::String>(r), variables));
+            }
+        }
+        recipes.emplace_back(recipe.take());
+    }
+    size_t lineno = std::visit([](const auto& t) { return t.lineno; },
+                               rule->targets.front());
+    return std::make_shared<Rule>(expandWords(rule->targets, variables),
+                                  expandWords(rule->prereqs, variables),
+                                  recipes, lineno);
+}
+}  // namespace var_replacement
@@ -0,0 +1,69 @@
+#include "var-resolution.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+#include "var-replacement.h"
+
+namespace var_resolution {
+
+using Definitions = std::unordered_map<std::string, const parser::VarDef*>;
+using Resolved = std::unordered_map<std::string, std::vector<std::string>>;
+
+static const std::vector<std::string>& resolve(
+    const std::string& name, const Definitions& definitions,
+    Resolved& resolved, std::unordered_set<std::string>& inProgress) {
+    auto it = resolved.find(name);
+    if (it != resolved.end()) {
+        return it->second;
+    }
+    static const std::vector<std::string> empty;
+    auto defIt = definitions.find(name);
+    if (defIt == definitions.end()) {
+        return empty;
+    }
+    if (inProgress.contains(name)) {
+        throw VarResolutionException(
+            {"Recursive variable", name, "references itself, line:",
+             std::to_string(defIt->second->varName.lineno)});
+    }
+    inProgress.insert(name);
+
+    var_replacement::WordBuilder<std::string> values;
+    for (const auto& v : defIt->second->values) {
+        if (std::holds_alternative<lexer::Word>(v)) {
+            const auto& word = std::get<lexer::Word>(v);
+            values.beginToken(word.joined);
+            values.add(word.name);
+        } else {
+            const auto& var = std::get<lexer::Var>(v);
+            values.beginToken(var.joined);
+            for (const auto& value :
+                 resolve(var.name, definitions, resolved, inProgress)) {
+                values.add(value);
+            }
+        }
+    }
+    inProgress.erase(name);
+    return resolved.emplace(name, values.take()).first->second;
+}
+
+std::unordered_map<std::string, std::vector<std::string>> resolveVariables(
+    const std::vector<parser::VarDef>& varAssignments) {
+    Definitions definitions;
+    for (const auto& vd : varAssignments) {
+        definitions.insert_or_assign(vd.varName.name, &vd);
+    }
+    Resolved resolved;
+    std::unordered_set<std::string> inProgress;
+    for (const auto& [name, vd] : definitions) {
+        resolve(name, definitions, resolved, inProgress);
+    }
+    return resolved;
+}
+}  // namespace var_resolution
@@ -0,0 +1,88 @@
+#include "action-cache.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+
+#include "auto-var-replacement.h"
+#include "test-helpers.h"
+
+namespace fs = std::filesystem;
+
+class ActionCacheTest : public TempDirTest {};
+
+TEST_F(ActionCacheTest, RestoresStoredTargets) {
+    action_cache::ActionCache cache("cache");
+    writeFile("in.txt", "input");
+    auto_var_replacement::Rule rule({"out.txt"}, {"in.txt"},
+                                    {"cp in.txt out.txt"}, 1);
+    std::string key = cache.actionKey(rule);
+    EXPECT_FALSE(cache.restore(key));
+
+    writeFile("out.txt", "output");
+    cache.store(key, rule.targets);
+    fs::remove("out.txt");
+
+    EXPECT_TRUE(cache.restore(key));
+    EXPECT_EQ(readFile("out.txt"), "output");
+}
+
+TEST_F(ActionCacheTest, KeyDependsOnRecipesAndPrereqContent) {
+    action_cache::ActionCache cache("cache");
+    writeFile("in.txt", "v1");
+    auto_var_replacement::Rule rule({"out"}, {"in.txt"}, {"cc in.txt"}, 1);
+    auto_var_replacement::Rule otherRecipe({"out"}, {"in.txt"},
+                                           {"cc -O2 in.txt"}, 1);
+    std::string key = cache.actionKey(rule);
+    EXPECT_EQ(key, cache.actionKey(rule));
+    EXPECT_NE(key, cache.actionKey(otherRecipe));
+
+    writeFile("in.txt", "v2");
+    EXPECT_NE(key, cache.actionKey(rule));
+    writeFile("in.txt", "v1");
+    EXPECT_EQ(key, cache.actionKey(rule));
+}
+
+TEST_F(ActionCacheTest, PhonyTargetsAreNotCached) {
+    action_cache::ActionCache cache("cache");
+    auto_var_replacement::Rule rule({"clean"}, {}, {"rm -f out"}, 1);
+    std::string key = cache.actionKey(rule);
+    cache.store(key, rule.targets);
+    EXPECT_FALSE(cache.restore(key));
+}
+
+TEST_F(ActionCacheTest, RestoredTargetsAreIndependentOfTheCache) {
+    action_cache::ActionCache cache("cache");
+    auto_var_replacement::Rule rule({"out.txt"}, {}, {"gen"}, 1);
+    std::string key = cache.actionKey(rule);
+    writeFile("out.txt", "output");
+    cache.store(key, rule.targets);
+    fs::remove("out.txt");
+    ASSERT_TRUE(cache.restore(key));
+
+    auto perms = fs::status("out.txt").permissions();
+    EXPECT_NE(perms & fs::perms::owner_write, fs::perms::none);
+    // Overwrite in place, like a recipe rebuilding the target would.
+    writeFile("out.txt", "rebuilt");
+    fs::remove("out.txt");
+    ASSERT_TRUE(cache.restore(key));
+    EXPECT_EQ(readFile("out.txt"), "output");
+}
+
+TEST_F(ActionCacheTest, CorruptedBlobIsAMiss) {
+    action_cache::ActionCache cache("cache");
+    auto_var_replacement::Rule rule({"out.txt"}, {}, {"gen"}, 1);
+    std::string key = cache.actionKey(rule);
+    writeFile("out.txt", "output");
+    cache.store(key, rule.targets);
+    for (const auto& blob : fs::directory_iterator("cache/blobs")) {
+        fs::permissions(blob, fs::perms::owner_write, fs::perm_options::add);
+        writeFile(blob, "tampered");
+    }
+    writeFile("out.txt", "local");
+
+    EXPECT_FALSE(cache.restore(key));
+    EXPECT_EQ(readFile("out.txt"), "local");
+    EXPECT_TRUE(fs::is_empty("cache/blobs"));
+}
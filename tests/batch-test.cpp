@@ -0,0 +1,56 @@
+#include "batch.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "lexer.h"
+#include "parser.h"
+#include "test-helpers.h"
+#include "var-replacement.h"
+
+static RuleList expand(const std::string& makefile) {
+    auto [varDefs, rules] = parser::parse(lexer::lex(makefile));
+    RuleList result;
+    for (const auto& r : rules) {
+        result.emplace_back(auto_var_replacement::replace(
+            var_replacement::replace(std::make_shared<parser::Rule>(r), {})));
+    }
+    return result;
+}
+
+TEST(BatchTest, RulesDifferingInAutomaticVariablesShareTheirTemplate) {
+    auto rules = expand(
+        "a.ok: a.c\n\tlint --fix $< \"$@\"\n"
+        "b.ok: b.c\n\tlint --fix $< \"$@\"\n"
+        "c.ok: c.c\n\tlint $< \"$@\"\n"
+        "d: e\n\techo $@\n\techo done\n");
+    EXPECT_EQ(rules[0]->recipeTemplate, rules[1]->recipeTemplate);
+    EXPECT_NE(rules[0]->recipeTemplate, rules[2]->recipeTemplate);
+    EXPECT_EQ(rules[0]->argsOffset, 11);
+    EXPECT_TRUE(rules[3]->recipeTemplate.empty());
+    EXPECT_EQ(batch::combinedCommand({rules[0].get(), rules[1].get()}),
+              "lint --fix a.c \"a.ok\" b.c \"b.ok\"");
+}
+
+TEST(BatchTest, TakesBatchRulesOut) {
+    auto rules = expand(
+        ".BATCH: a.ok c.ok missing\n"
+        "a.ok: a.c\n\tlint $<\n"
+        "b.ok: b.c\n\tlint $<\n"
+        "c.ok: c.c\n\tlint $<\n");
+    auto batchable = batch::takeBatchable(rules);
+    ASSERT_EQ(rules.size(), 3);
+    EXPECT_EQ(rules[0]->targets.front(), "a.ok");
+    EXPECT_EQ(batchable, (std::vector<bool>{true, false, true}));
+}
+
+TEST(BatchTest, RejectsRulesWithoutTemplate) {
+    auto rules = expand(
+        ".BATCH: a\n"
+        "a: b\n\ttouch a\n");
+    EXPECT_THROW(batch::takeBatchable(rules), batch::BatchException);
+}
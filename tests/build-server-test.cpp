@@ -0,0 +1,167 @@
+#include "build-server.h"
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "driver.h"
+#include "scheduler.h"
+#include "test-helpers.h"
+
+namespace fs = std::filesystem;
+
+class BuildServerTest : public TempDirTest {
+   protected:
+    /**
+     * @brief Forwards `args` to `server` while it serves one request.
+     */
+    static std::optional<int> request(build_server::Server& server,
+                                      const std::vector<std::string>& args,
+                                      std::ostream& out, std::ostream& err) {
+        std::thread serving([&server] { server.serveNext(); });
+        auto status = build_server::forward("test.sock", args, out, err);
+        serving.join();
+        return status;
+    }
+};
+
+TEST_F(BuildServerTest, ServesARequest) {
+    writeFile("Makefile",
+              "out: in\n"
+              "\tcp in out\n");
+    writeFile("in", "1");
+    build_server::Server server(2, "test.sock");
+    std::ostringstream out;
+    std::ostringstream err;
+    EXPECT_EQ(request(server, {"-t", "2"}, out, err), 0);
+    EXPECT_NE(out.str().find("cp in out"), std::string::npos) << out.str();
+    EXPECT_EQ(err.str(), "");
+    EXPECT_EQ(readFile("out"), "1");
+}
+
+TEST_F(BuildServerTest, ReportsErrorsLikeInProcessRuns) {
+    writeFile("Makefile",
+              "out:\n"
+              "\tfalse\n");
+    std::ostringstream expectedOut;
+    std::ostringstream expectedErr;
+    try {
+        driver::Session session(1);
+        driver::run(driver::parseOptions({}), session, expectedOut);
+    } catch (const std::exception& e) {
+        driver::reportError(e, expectedErr);
+    }
+    ASSERT_NE(expectedErr.str(), "");
+
+    build_server::Server server(1, "test.sock");
+    std::ostringstream out;
+    std::ostringstream err;
+    EXPECT_EQ(request(server, {}, out, err), 1);
+    EXPECT_EQ(out.str(), expectedOut.str());
+    EXPECT_EQ(err.str(), expectedErr.str());
+}
+
+TEST_F(BuildServerTest, ForwardFallsBackWithoutAServer) {
+    std::ostringstream out;
+    std::ostringstream err;
+    EXPECT_EQ(build_server::forward("test.sock", {}, out, err), std::nullopt);
+
+    { build_server::Server server(1, "test.sock"); }
+    EXPECT_FALSE(fs::exists("test.sock"));
+
+    // Socket file left behind by a server that was killed.
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, "test.sock");
+    ASSERT_EQ(::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    ::close(fd);
+    ASSERT_TRUE(fs::exists("test.sock"));
+    EXPECT_EQ(build_server::forward("test.sock", {}, out, err), std::nullopt);
+    EXPECT_EQ(out.str(), "");
+}
+
+TEST_F(BuildServerTest, ChangedFilesInvalidateTheSession) {
+    writeFile("Makefile",
+              "out: in\n"
+              "\tcp in out\n");
+    writeFile("in", "1");
+    build_server::Server server(2, "test.sock");
+    std::ostringstream out;
+    std::ostringstream err;
+    ASSERT_EQ(request(server, {}, out, err), 0);
+    ASSERT_EQ(request(server, {}, out, err), 0);
+    const driver::BuildState* state = server.session.buildState.get();
+    ASSERT_NE(state, nullptr);
+    uint64_t statCalls = state->mtimes.statCalls();
+
+    // Nothing changed: neither re-loaded nor re-stat-ed.
+    out.str("");
+    ASSERT_EQ(request(server, {}, out, err), 0);
+    EXPECT_EQ(server.session.buildState.get(), state);
+    EXPECT_EQ(state->mtimes.statCalls(), statCalls);
+    EXPECT_NE(out.str().find("Nothing to be done for 'out'"),
+              std::string::npos)
+        << out.str();
+
+    writeFile("in", "2");
+    touchLater("in");
+    out.str("");
+    ASSERT_EQ(request(server, {}, out, err), 0);
+    EXPECT_NE(out.str().find("cp in out"), std::string::npos) << out.str();
+    EXPECT_EQ(readFile("out"), "2");
+
+    writeFile("Makefile",
+              "copy: in\n"
+              "\tcp in copy\n");
+    out.str("");
+    ASSERT_EQ(request(server, {}, out, err), 0);
+    EXPECT_NE(out.str().find("cp in copy"), std::string::npos) << out.str();
+    EXPECT_EQ(err.str(), "");
+}
+
+TEST_F(BuildServerTest, RecipesDoNotForwardToTheBusyServer) {
+    writeFile("Makefile",
+              "out:\n"
+              "\tprintenv TINYMAKE_NO_FORWARD\n");
+    build_server::Server server(1, "test.sock");
+    std::ostringstream out;
+    std::ostringstream err;
+    ASSERT_EQ(request(server, {}, out, err), 0) << err.str();
+    EXPECT_NE(out.str().find("\n1\n"), std::string::npos) << out.str();
+
+    // A nested invocation falls back to an in-process run instead of waiting
+    // on the server that is running its recipe.
+    ::setenv(scheduler::IN_RECIPE_VARIABLE, "1", 1);
+    auto status = build_server::forward("test.sock", {}, out, err);
+    ::unsetenv(scheduler::IN_RECIPE_VARIABLE);
+    EXPECT_EQ(status, std::nullopt);
+}
+
+TEST_F(BuildServerTest, ReportsJobsCappedByTheServerPool) {
+    writeFile("Makefile",
+              "out:\n"
+              "\ttrue\n");
+    build_server::Server server(2, "test.sock");
+    std::ostringstream out;
+    std::ostringstream err;
+    ASSERT_EQ(request(server, {"-t", "8"}, out, err), 0);
+    EXPECT_EQ(err.str(),
+              "TinyMake: -t 8 capped to the build server's 2 threads\n");
+
+    err.str("");
+    ASSERT_EQ(request(server, {"-t", "2"}, out, err), 0);
+    EXPECT_EQ(err.str(), "");
+}
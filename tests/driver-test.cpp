@@ -0,0 +1,258 @@
+#include "driver.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+#include "test-helpers.h"
+
+namespace fs = std::filesystem;
+
+class DriverTest : public TempDirTest {
+   protected:
+    static std::string build(const std::vector<std::string>& args) {
+        driver::Options options = driver::parseOptions(args);
+        driver::Session session(4);
+        std::ostringstream out;
+        driver::run(options, session, out);
+        return out.str();
+    }
+};
+
+TEST_F(DriverTest, BuildsOnlyOutOfDateTargets) {
+    writeFile("Makefile",
+              "all: a.out b.out\n"
+              "a.out: a.in\n"
+              "\tcp $< $@\n"
+              "b.out: b.in\n"
+              "\tcp $^ $@\n");
+    writeFile("a.in", "A");
+    writeFile("b.in", "B");
+    std::string out = build({});
+    EXPECT_NE(out.find("cp a.in a.out"), std::string::npos) << out;
+    EXPECT_NE(out.find("cp b.in b.out"), std::string::npos) << out;
+    EXPECT_EQ(readFile("a.out"), "A");
+
+    out = build({"a.out", "b.out"});
+    EXPECT_NE(out.find("Nothing to be done for 'a.out'"), std::string::npos)
+        << out;
+
+    touchLater("b.in");
+    out = build({});
+    EXPECT_EQ(out.find("a.in"), std::string::npos) << out;
+    EXPECT_NE(out.find("cp b.in b.out"), std::string::npos) << out;
+}
+
+TEST_F(DriverTest, PrerequisitesAreBuiltFirst) {
+    writeFile("Makefile",
+              "c: b\n"
+              "\tcp b c\n"
+              "b: a\n"
+              "\tcp a b\n"
+              "a: seed\n"
+              "\tcp seed a\n");
+    writeFile("seed", "chain");
+    build({"-t", "4"});
+    EXPECT_EQ(readFile("c"), "chain");
+}
+
+TEST_F(DriverTest, FailingRecipeStopsTheBuild) {
+    writeFile("Makefile",
+              "all: bad\n"
+              "\ttouch all\n"
+              "bad:\n"
+              "\tfalse\n");
+    EXPECT_THROW(build({}), RuntimeException);
+    EXPECT_FALSE(fs::exists("all"));
+}
+
+TEST_F(DriverTest, MissingPrerequisiteIsReported) {
+    writeFile("Makefile", "all: missing.c\n\ttouch all\n");
+    EXPECT_THROW(build({}), RuntimeException);
+}
+
+TEST_F(DriverTest, ActionCacheSkipsRecipes) {
+    writeFile("Makefile", "out: in\n\tcp in out\n");
+    writeFile("in", "v1");
+    build({"--cache-dir", "cache"});
+    fs::remove("out");
+    std::string out = build({"--cache-dir", "cache"});
+    EXPECT_NE(out.find("restored from cache: out"), std::string::npos) << out;
+    EXPECT_EQ(readFile("out"), "v1");
+
+    writeFile("in", "v2");
+    touchLater("in");
+    out = build({"--cache-dir", "cache"});
+    EXPECT_NE(out.find("cp in out"), std::string::npos) << out;
+    EXPECT_EQ(readFile("out"), "v2");
+
+    // `cp` wrote through the restored `out`, which must not have changed the
+    // cached output of v1.
+    writeFile("in", "v1");
+    touchLater("in");
+    out = build({"--cache-dir", "cache"});
+    EXPECT_NE(out.find("restored from cache: out"), std::string::npos) << out;
+    EXPECT_EQ(readFile("out"), "v1");
+}
+
+TEST_F(DriverTest, ShardsTogetherBuildEverything) {
+    writeFile("Makefile",
+              "all: a.out b.out c.out d.out\n"
+              "a.out: a.in\n\tcp $< $@\n"
+              "b.out: b.in\n\tcp $< $@\n"
+              "c.out: c.in\n\tcp $< $@\n"
+              "d.out: d.in\n\tcp $< $@\n");
+    for (auto name : {"a", "b", "c", "d"}) {
+        writeFile(std::string(name) + ".in", name);
+    }
+    std::string first = build({"--shard", "1/2"});
+    EXPECT_TRUE(fs::exists("a.out"));
+    EXPECT_FALSE(fs::exists("b.out"));
+    EXPECT_TRUE(fs::exists("c.out"));
+    EXPECT_FALSE(fs::exists("d.out"));
+    build({"--shard", "2/2"});
+    for (auto name : {"a", "b", "c", "d"}) {
+        EXPECT_EQ(readFile(std::string(name) + ".out"), name);
+    }
+    EXPECT_EQ(build({}).find("cp "), std::string::npos);
+    EXPECT_NE(build({"--shard", "5/5"}).find("Nothing to be done for shard"),
+              std::string::npos);
+}
+
+TEST_F(DriverTest, ConcurrentShardsBuildSharedPrerequisitesOnce) {
+    // `common` is slow, so the other shard has to wait for it.
+    writeFile("Makefile",
+              "all: a.out b.out\n"
+              "a.out: common a.in\n\tcp a.in $@\n"
+              "b.out: common b.in\n\tcp b.in $@\n"
+              "common:\n\tsleep 0.3\n\tmktemp ran.XXXXXX\n\ttouch common\n");
+    writeFile("a.in", "a");
+    writeFile("b.in", "b");
+    std::string outputs[2];
+    std::exception_ptr errors[2];
+    std::vector<std::thread> shards;
+    for (int i = 0; i < 2; i++) {
+        shards.emplace_back([&, i] {
+            try {
+                outputs[i] =
+                    build({"--shard", std::to_string(i + 1) + "/2"});
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& shard : shards) {
+        shard.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    size_t runs = 0;
+    for (const auto& entry : fs::directory_iterator(".")) {
+        runs += entry.path().filename().string().starts_with("ran.") ? 1 : 0;
+    }
+    EXPECT_EQ(runs, 1);
+    EXPECT_NE(outputs[0].find("touch common"), std::string::npos)
+        << outputs[0];
+    EXPECT_EQ(outputs[1].find("touch common"), std::string::npos)
+        << outputs[1];
+    EXPECT_EQ(readFile("a.out"), "a");
+    EXPECT_EQ(readFile("b.out"), "b");
+    EXPECT_LE(fs::last_write_time("common"), fs::last_write_time("b.out"));
+}
+
+TEST_F(DriverTest, ShardGivesUpWaitingAfterTheTimeout) {
+    writeFile("Makefile",
+              "a.out: common\n\ttouch $@\n"
+              "b.out: common\n\ttouch $@\n"
+              "common:\n\ttouch common\n");
+    EXPECT_THROW(build({"a.out", "b.out", "--shard", "2/2",
+                        "--shard-timeout", "0"}),
+                 scheduler::SchedulerException);
+    EXPECT_FALSE(fs::exists("common"));
+    EXPECT_FALSE(fs::exists("b.out"));
+}
+
+TEST_F(DriverTest, RejectsMalformedShards) {
+    for (auto arg : {"0/2", "3/2", "1", "1/x", "x/2", "1/2x"}) {
+        EXPECT_THROW(driver::parseOptions({"--shard", arg}),
+                     std::runtime_error)
+            << arg;
+    }
+    auto options = driver::parseOptions({"--shard", "2/4"});
+    EXPECT_EQ(options.shardIndex, 1);
+    EXPECT_EQ(options.numShards, 4);
+}
+
+TEST_F(DriverTest, BatchesRulesSharingTheirRecipe) {
+    std::string makefile = "all: a b c d e\n.BATCH: a b c d e\n";
+    for (auto name : {"a", "b", "c", "d", "e"}) {
+        makefile += std::string(name) + ":\n\ttouch $@\n";
+    }
+    writeFile("Makefile", makefile);
+    std::string out = build({"--batch-size", "3"});
+    EXPECT_NE(out.find("touch a b\n"), std::string::npos) << out;
+    EXPECT_NE(out.find("touch c d e\n"), std::string::npos) << out;
+    for (auto name : {"a", "b", "c", "d", "e"}) {
+        EXPECT_TRUE(fs::exists(name)) << name;
+    }
+
+    fs::remove("c");
+    out = build({});
+    EXPECT_EQ(out, "touch c\n");
+}
+
+TEST_F(DriverTest, SessionReusesStateWhileWatched) {
+    writeFile("Makefile",
+              "out: in\n"
+              "\tcp in out\n");
+    writeFile("in", "1");
+    driver::Options options = driver::parseOptions({});
+    driver::Session session(4);
+    std::ostringstream out;
+    driver::run(options, session, out);
+    ASSERT_NE(session.buildState, nullptr);
+    EXPECT_FALSE(session.buildState->reusable);
+    for (const auto& dir : session.directories()) {
+        session.setWatched(dir, true);
+    }
+
+    // Loaded again, the Makefile could have changed before it was watched.
+    driver::run(options, session, out);
+    const driver::BuildState* state = session.buildState.get();
+    ASSERT_TRUE(state->reusable);
+    uint64_t statCalls = state->mtimes.statCalls();
+
+    out.str("");
+    driver::run(options, session, out);
+    EXPECT_EQ(session.buildState.get(), state);
+    EXPECT_EQ(state->mtimes.statCalls(), statCalls);
+    EXPECT_NE(out.str().find("Nothing to be done for 'out'"),
+              std::string::npos)
+        << out.str();
+
+    touchLater("in");
+    session.invalidate(fs::absolute("in"));
+    out.str("");
+    driver::run(options, session, out);
+    EXPECT_EQ(session.buildState.get(), state);
+    EXPECT_NE(out.str().find("cp in out"), std::string::npos) << out.str();
+
+    writeFile("Makefile",
+              "copy: in\n"
+              "\tcp in copy\n");
+    session.invalidate(fs::absolute("Makefile"));
+    EXPECT_EQ(session.buildState, nullptr);
+    out.str("");
+    driver::run(options, session, out);
+    EXPECT_NE(out.str().find("cp in copy"), std::string::npos) << out.str();
+}
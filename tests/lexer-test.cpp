@@ -1,3 +1,103 @@
 #include "lexer.h"
 
 #include <gtest/gtest.h>
+
+#include <cstddef>
+#include <string>
+#include <variant>
+#include <vector>
+
+static std::vector<std::string> toStrings(
+    const std::vector<lexer::Token>& tokens) {
+    std::vector<std::string> result;
+    for (const auto& t : tokens) {
+        result.emplace_back(lexer::toString(t));
+    }
+    return result;
+}
+
+static std::vector<size_t> linenos(const std::vector<lexer::Token>& tokens) {
+    std::vector<size_t> result;
+    for (const auto& t : tokens) {
+        result.emplace_back(lexer::linenoOf(t));
+    }
+    return result;
+}
+
+TEST(LexerTest, LexLinesSplitsAtLogicalLines) {
+    std::string input = "a = b\nall: a \\\n b\n\techo hi";
+    std::vector<std::vector<std::string>> lines;
+    for (const auto& line : lexer::lexLines(input)) {
+        lines.emplace_back(toStrings(line));
+    }
+    std::vector<std::vector<std::string>> expected{
+        {"(Word a)", "(Equal)", "(Word b)", "(Endl)"},
+        {"(Word all)", "(Colon)", "(Word a)", "(Word b)", "(Endl)"},
+        {"(Tab)", "(Word echo)", "(Word hi)"},
+    };
+    EXPECT_EQ(lines, expected);
+}
+
+TEST(LexerTest, LexMatchesConcatenatedLines) {
+    std::string input = "CC = gcc\n# comment\nmain: main.o\n\t$(CC) -o main\n";
+    std::vector<std::string> streamed;
+    for (const auto& line : lexer::lexLines(input)) {
+        auto strings = toStrings(line);
+        streamed.insert(streamed.end(), strings.begin(), strings.end());
+    }
+    EXPECT_EQ(toStrings(lexer::lex(input)), streamed);
+}
+
+TEST(LexerTest, LexLinesRethrowsErrors) {
+    std::string input = "a = b\n!\n";
+    auto lines = lexer::lexLines(input);
+    auto it = lines.begin();
+    EXPECT_EQ(it->size(), 4);
+    EXPECT_THROW(++it, lexer::LexerException);
+}
+
+TEST(LexerTest, PinsTokenStream) {
+    auto tokens = lexer::lex(
+        "CC := gcc\n"
+        "FLAGS = -O2 $(CC) $X\n"
+        "# comment\n"
+        "all: main.o \\\n"
+        " util.o\n"
+        "\n"
+        "%.o: %.c\n"
+        "\t$(CC) -c $< -o $@ $^ \"s $@ $(CC) $$ \\t x\"\n"
+        "\techo $$ $ end\n");
+    std::vector<std::string> expected{
+        "(Word CC)", "(Equal)", "(Word gcc)", "(Endl)",
+        "(Word FLAGS)", "(Equal)", "(Word -O2)", "(Var CC)", "(Var X)",
+        "(Endl)", "(Endl)",
+        "(Word all)", "(Colon)", "(Word main.o)", "(Word util.o)", "(Endl)",
+        "(Endl)",
+        "(Word %.o)", "(Colon)", "(Word %.c)", "(Endl)",
+        "(Tab)", "(Var CC)", "(Word -c)", "(AutoVar $<)", "(Word -o)",
+        "(AutoVar $@)", "(AutoVar $^)",
+        "(String s (AutoVar $@) (Var CC) (Dollar) \t x)", "(Endl)",
+        "(Tab)", "(Word echo)", "(Word $)", "(Word )", "(Word end)", "(Endl)"};
+    EXPECT_EQ(toStrings(tokens), expected);
+    std::vector<size_t> expectedLinenos{1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 3, 4,
+                                        4, 4, 5, 5, 6, 7, 7, 7, 7, 8, 8, 8,
+                                        8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9};
+    EXPECT_EQ(linenos(tokens), expectedLinenos);
+}
+
+TEST(LexerTest, AutomaticVariablesAreTheirOwnKind) {
+    auto tokens = lexer::lex("\t$@ $< $^ $(A) $A");
+    ASSERT_EQ(tokens.size(), 6);
+    EXPECT_TRUE(std::holds_alternative<lexer::Tab>(tokens[0]));
+    for (size_t i = 1; i <= 3; i++) {
+        EXPECT_TRUE(std::holds_alternative<lexer::AutoVar>(tokens[i])) << i;
+    }
+    EXPECT_EQ(std::get<lexer::AutoVar>(tokens[1]).type,
+              lexer::AutoVar::DOLLAR_AT);
+    EXPECT_EQ(std::get<lexer::AutoVar>(tokens[2]).type,
+              lexer::AutoVar::DOLLAR_LT);
+    EXPECT_EQ(std::get<lexer::AutoVar>(tokens[3]).type,
+              lexer::AutoVar::DOLLAR_SUP);
+    EXPECT_EQ(std::get<lexer::Var>(tokens[4]).name, "A");
+    EXPECT_EQ(std::get<lexer::Var>(tokens[5]).name, "A");
+}
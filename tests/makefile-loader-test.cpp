@@ -0,0 +1,125 @@
+#include "makefile-loader.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "test-helpers.h"
+#include "thread-pool.h"
+
+namespace fs = std::filesystem;
+
+class MakefileLoaderTest : public TempDirTest {
+   protected:
+    thread_pool::ThreadPool pool{4};
+    makefile_loader::ParseCache cache;
+};
+
+static std::vector<std::string> varNames(
+    const std::vector<parser::VarDef>& varDefs) {
+    std::vector<std::string> names;
+    for (const auto& vd : varDefs) {
+        names.emplace_back(vd.varName.name);
+    }
+    return names;
+}
+
+TEST_F(MakefileLoaderTest, MergesIncludesInSourceOrder) {
+    writeFile("Makefile",
+              "A = 1\n"
+              "include b.mk c.mk\n"
+              "D = 4\n"
+              "-include missing.mk\n"
+              "all: x\n");
+    writeFile("b.mk", "B = 2\ninclude nested.mk\nb: x\n");
+    writeFile("nested.mk", "N = 0\n");
+    writeFile("c.mk", "C = 3\n");
+    auto [varDefs, rules] = makefile_loader::load("Makefile", pool, cache);
+    std::vector<std::string> expected{"A", "B", "N", "C", "D"};
+    EXPECT_EQ(varNames(varDefs), expected);
+    ASSERT_EQ(rules.size(), 2);
+    EXPECT_EQ(std::get<lexer::Word>(rules[0].targets[0]).name, "b");
+    EXPECT_EQ(std::get<lexer::Word>(rules[1].targets[0]).name, "all");
+}
+
+TEST_F(MakefileLoaderTest, MissingIncludeIsAnError) {
+    writeFile("Makefile", "include missing.mk\n");
+    EXPECT_THROW(makefile_loader::load("Makefile", pool, cache),
+                 makefile_loader::LoaderException);
+}
+
+TEST_F(MakefileLoaderTest, RecursiveIncludeIsAnError) {
+    writeFile("Makefile", "include a.mk\n");
+    writeFile("a.mk", "include Makefile\n");
+    EXPECT_THROW(makefile_loader::load("Makefile", pool, cache),
+                 makefile_loader::LoaderException);
+}
+
+TEST_F(MakefileLoaderTest, CacheReusesUnchangedFiles) {
+    writeFile("a.mk", "A = 1\n");
+    auto first = cache.get("a.mk");
+    EXPECT_EQ(cache.get("a.mk"), first);
+
+    // Same content, new mtime: reused after rehashing.
+    fs::last_write_time("a.mk", fs::last_write_time("a.mk") +
+                                    std::chrono::seconds(1));
+    EXPECT_EQ(cache.get("a.mk"), first);
+
+    writeFile("a.mk", "A = 2\nB = 3\n");
+    fs::last_write_time("a.mk", fs::last_write_time("a.mk") +
+                                    std::chrono::seconds(2));
+    auto second = cache.get("a.mk");
+    EXPECT_NE(second, first);
+    EXPECT_EQ(second->size(), 2);
+}
+
+TEST_F(MakefileLoaderTest, CacheDirectoryReusesEntriesAcrossRuns) {
+    writeFile("Makefile", "A = 1\ninclude b.mk\nall: b\n\techo \"$@\"\n");
+    writeFile("b.mk", "B = 2\n");
+    cache.setDirectory("parse");
+    auto [varDefs, rules] = makefile_loader::load("Makefile", pool, cache);
+    ASSERT_GT(cache.tokensLexed(), 0);
+
+    makefile_loader::ParseCache nextRun;
+    nextRun.setDirectory("parse");
+    auto [nextVarDefs, nextRules] =
+        makefile_loader::load("Makefile", pool, nextRun);
+    EXPECT_EQ(nextRun.tokensLexed(), 0);
+    EXPECT_EQ(varNames(nextVarDefs), varNames(varDefs));
+    ASSERT_EQ(nextRules.size(), 1);
+    EXPECT_EQ(nextRules[0].toString(), rules[0].toString());
+
+    // Same content, new mtime: reused after rehashing.
+    fs::last_write_time("b.mk", fs::last_write_time("b.mk") +
+                                    std::chrono::seconds(1));
+    makefile_loader::ParseCache touched;
+    touched.setDirectory("parse");
+    makefile_loader::load("Makefile", pool, touched);
+    EXPECT_EQ(touched.tokensLexed(), 0);
+
+    writeFile("b.mk", "B = 3\n");
+    fs::last_write_time("b.mk", fs::last_write_time("b.mk") +
+                                    std::chrono::seconds(2));
+    makefile_loader::ParseCache changed;
+    changed.setDirectory("parse");
+    makefile_loader::load("Makefile", pool, changed);
+    EXPECT_GT(changed.tokensLexed(), 0);
+}
+
+TEST_F(MakefileLoaderTest, CorruptedPersistedEntriesAreMisses) {
+    writeFile("a.mk", "A = 1\n");
+    cache.setDirectory("parse");
+    cache.get("a.mk");
+    for (const auto& entry : fs::directory_iterator("parse")) {
+        std::string content = readFile(entry.path());
+        writeFile(entry.path(), content.substr(0, content.size() - 3));
+    }
+
+    makefile_loader::ParseCache nextRun;
+    nextRun.setDirectory("parse");
+    ASSERT_EQ(nextRun.get("a.mk")->size(), 1);
+    EXPECT_GT(nextRun.tokensLexed(), 0);
+}
@@ -0,0 +1,77 @@
+#include "parser.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "lexer.h"
+
+static std::vector<std::string> toStrings(
+    const std::pair<std::vector<parser::VarDef>, std::vector<parser::Rule>>&
+        parsed) {
+    std::vector<std::string> result;
+    for (const auto& vd : parsed.first) {
+        result.emplace_back(vd.toString());
+    }
+    for (const auto& r : parsed.second) {
+        result.emplace_back(r.toString());
+    }
+    return result;
+}
+
+TEST(ParserTest, StreamingMatchesBatch) {
+    std::string input =
+        "CC = gcc\n"
+        "all: main\n"
+        "\n"
+        "main: main.o util.o\n"
+        "\t$(CC) -o main main.o util.o\n"
+        "\n"
+        "\techo done\n"
+        "FLAGS = -O2 $(CC)\n"
+        "clean:\n"
+        "\trm -f main\n";
+    auto batch = parser::parse(lexer::lex(input));
+    auto streamed = parser::parse(lexer::lexLines(input));
+    EXPECT_EQ(batch.first.size(), 2);
+    EXPECT_EQ(batch.second.size(), 3);
+    EXPECT_EQ(batch.second[1].recipes.size(), 2);
+    EXPECT_EQ(toStrings(batch), toStrings(streamed));
+}
+
+TEST(ParserTest, StreamingReportsErrors) {
+    std::string input = "a = b\n\techo orphan\n";
+    EXPECT_THROW(parser::parse(lexer::lexLines(input)),
+                 parser::ParserException);
+    EXPECT_THROW(parser::parse(lexer::lex(input)), parser::ParserException);
+}
+
+TEST(ParserTest, RejectsUnexpectedPrerequisite) {
+    std::string input = "a: b = c\n";
+    EXPECT_THROW(parser::parse(lexer::lex(input)), parser::ParserException);
+}
+
+TEST(ParserTest, KeepsEveryTokenKindOfRecipes) {
+    auto [varDefs, rules] =
+        parser::parse(lexer::lex("a: b\n\tcp $< $(DIR)/$@ \"$^\"\n"));
+    ASSERT_EQ(rules.size(), 1);
+    ASSERT_EQ(rules[0].recipes.size(), 1);
+    const auto& recipe = rules[0].recipes[0];
+    ASSERT_EQ(recipe.size(), 6);
+    EXPECT_EQ(std::get<lexer::Word>(recipe[0]).name, "cp");
+    EXPECT_EQ(std::get<lexer::AutoVar>(recipe[1]).type,
+              lexer::AutoVar::DOLLAR_LT);
+    EXPECT_EQ(std::get<lexer::Var>(recipe[2]).name, "DIR");
+    EXPECT_EQ(std::get<lexer::Word>(recipe[3]).name, "/");
+    EXPECT_EQ(std::get<lexer::AutoVar>(recipe[4]).type,
+              lexer::AutoVar::DOLLAR_AT);
+    EXPECT_EQ(std::get<lexer::String>(recipe[5]).toString(),
+              "(String (AutoVar $^))");
+    // `$(DIR)/$@` is one word.
+    EXPECT_FALSE(std::get<lexer::Var>(recipe[2]).joined);
+    EXPECT_TRUE(std::get<lexer::Word>(recipe[3]).joined);
+    EXPECT_TRUE(std::get<lexer::AutoVar>(recipe[4]).joined);
+    EXPECT_FALSE(std::get<lexer::String>(recipe[5]).joined);
+}
@@ -0,0 +1,98 @@
+#include "partition.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "rule-dep.h"
+#include "test-helpers.h"
+
+static std::vector<std::vector<std::string>> shardNames(
+    const rule_dep::Graph& graph,
+    const std::vector<std::vector<rule_dep::NodeId>>& shards) {
+    std::vector<std::vector<std::string>> result;
+    for (const auto& shard : shards) {
+        result.emplace_back();
+        for (auto n : shard) {
+            result.back().emplace_back(graph.name(n));
+        }
+    }
+    return result;
+}
+
+TEST(PartitionTest, ExpandsAggregateGoals) {
+    RuleList rules{makeRule({"all"}, {"libs", "d"}, {}),
+                   makeRule({"libs"}, {"a", "b", "c"}, {}),
+                   makeRule({"a"}, {}), makeRule({"b"}, {}),
+                   makeRule({"c"}, {}), makeRule({"d"}, {})};
+    rule_dep::Graph graph(rules);
+    std::vector<rule_dep::NodeId> goals{graph.find("all").value()};
+    auto shards = partition::partitionGoals(graph, rules, goals, 2);
+    std::vector<std::vector<std::string>> expected{{"a", "c"}, {"b", "d"}};
+    EXPECT_EQ(shardNames(graph, shards.goals), expected);
+}
+
+TEST(PartitionTest, GoalsSharingPrerequisitesStayTogether) {
+    // Two families of binaries, each linking against its own large library.
+    RuleList rules{makeRule({"libx"}, {"x1", "x2", "x3"}),
+                   makeRule({"x1"}, {}), makeRule({"x2"}, {}),
+                   makeRule({"x3"}, {}),
+                   makeRule({"liby"}, {"y1", "y2", "y3"}),
+                   makeRule({"y1"}, {}), makeRule({"y2"}, {}),
+                   makeRule({"y3"}, {}), makeRule({"bin1"}, {"libx"}),
+                   makeRule({"bin2"}, {"liby"}), makeRule({"bin3"}, {"libx"}),
+                   makeRule({"bin4"}, {"liby"})};
+    rule_dep::Graph graph(rules);
+    std::vector<rule_dep::NodeId> goals;
+    for (auto name : {"bin1", "bin2", "bin3", "bin4"}) {
+        goals.emplace_back(graph.find(name).value());
+    }
+    auto shards = partition::partitionGoals(graph, rules, goals, 2);
+    std::vector<std::vector<std::string>> expected{{"bin1", "bin3"},
+                                                   {"bin2", "bin4"}};
+    EXPECT_EQ(shardNames(graph, shards.goals), expected);
+}
+
+TEST(PartitionTest, EveryGoalIsInExactlyOneShard) {
+    RuleList rules;
+    std::vector<std::string> objects;
+    for (int i = 0; i < 50; i++) {
+        std::string name = "o";
+        name += std::to_string(i);
+        rules.emplace_back(makeRule({name}, {"common.h"}));
+        objects.emplace_back(name);
+    }
+    rules.insert(rules.begin(), makeRule({"all"}, objects, {}));
+    rule_dep::Graph graph(rules);
+    std::vector<rule_dep::NodeId> goals{graph.find("all").value()};
+    auto shards = partition::partitionGoals(graph, rules, goals, 3);
+    ASSERT_EQ(shards.goals.size(), 3);
+    std::multiset<std::string> seen;
+    for (const auto& shard : shardNames(graph, shards.goals)) {
+        EXPECT_GE(shard.size(), 16);
+        EXPECT_LE(shard.size(), 17);
+        seen.insert(shard.begin(), shard.end());
+    }
+    EXPECT_EQ(seen, std::multiset<std::string>(objects.begin(), objects.end()));
+}
+
+TEST(PartitionTest, SharedRulesHaveOneOwner) {
+    RuleList rules{makeRule({"lib"}, {"gen"}), makeRule({"gen"}, {}),
+                   makeRule({"bin1"}, {"lib"}), makeRule({"bin2"}, {"lib"}),
+                   makeRule({"bin3"}, {})};
+    rule_dep::Graph graph(rules);
+    std::vector<rule_dep::NodeId> goals;
+    for (auto name : {"bin1", "bin2", "bin3"}) {
+        goals.emplace_back(graph.find(name).value());
+    }
+    auto shards = partition::partitionGoals(graph, rules, goals, 2);
+    std::vector<std::vector<std::string>> expected{{"bin1"}, {"bin2", "bin3"}};
+    EXPECT_EQ(shardNames(graph, shards.goals), expected);
+    // Shard 0 builds `lib` and `gen`, shard 1 waits for `lib`.
+    EXPECT_EQ(shards.ownerOf, (std::vector<uint32_t>{0, 0, 0, 1, 1}));
+}
@@ -0,0 +1,145 @@
+#include "rule-dep.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "test-helpers.h"
+#include "thread-pool.h"
+
+static std::vector<std::string> names(
+    const rule_dep::Graph& graph, const std::vector<rule_dep::NodeId>& nodes) {
+    std::vector<std::string> result;
+    for (auto n : nodes) {
+        result.emplace_back(graph.name(n));
+    }
+    return result;
+}
+
+TEST(RuleDepTest, BuildsEdgesInBothDirections) {
+    RuleList rules{makeRule({"app"}, {"main.o", "util.o", "main.o"}),
+                   makeRule({"main.o"}, {"main.c", "util.h"}),
+                   makeRule({"util.o"}, {"util.c", "util.h"})};
+    rule_dep::Graph graph(rules);
+    EXPECT_EQ(graph.numNodes(), 6);
+    auto app = graph.find("app").value();
+    auto header = graph.find("util.h").value();
+    EXPECT_EQ(graph.prereqs(app).size(), 2);
+    EXPECT_EQ(graph.dependents(header).size(), 2);
+    EXPECT_EQ(graph.ruleOf(app), 0);
+    EXPECT_FALSE(graph.ruleOf(header).has_value());
+    EXPECT_FALSE(graph.find("missing").has_value());
+}
+
+TEST(RuleDepTest, MergesRulesForTheSameTarget) {
+    RuleList rules{makeRule({"a"}, {"b"}), makeRule({"a"}, {"c"}, {})};
+    rule_dep::Graph graph(rules);
+    auto a = graph.find("a").value();
+    EXPECT_EQ(graph.prereqs(a).size(), 2);
+    EXPECT_EQ(graph.ruleOf(a), 0);
+}
+
+TEST(RuleDepTest, ReverseReachableFollowsDependents) {
+    RuleList rules{makeRule({"app"}, {"main.o", "util.o"}),
+                   makeRule({"main.o"}, {"main.c"}),
+                   makeRule({"util.o"}, {"util.c"}),
+                   makeRule({"test"}, {"app"})};
+    rule_dep::Graph graph(rules);
+    thread_pool::ThreadPool pool(2);
+    std::vector<rule_dep::NodeId> seeds{graph.find("util.c").value()};
+    std::vector<std::string> expected{"app", "util.o", "util.c", "test"};
+    EXPECT_EQ(names(graph, rule_dep::reverseReachable(graph, seeds, pool)),
+              expected);
+}
+
+TEST(RuleDepTest, ReverseReachableOnLargeFanOut) {
+    constexpr size_t numObjects = 200000;
+    RuleList rules;
+    std::vector<std::string> objects;
+    for (size_t i = 0; i < numObjects; i++) {
+        objects.emplace_back(std::to_string(i) + ".o");
+        rules.emplace_back(makeRule({objects.back()},
+                                    {std::to_string(i) + ".c", "common.h"}));
+    }
+    rules.emplace_back(makeRule({"app"}, objects));
+    rule_dep::Graph graph(rules);
+    thread_pool::ThreadPool pool(4);
+
+    std::vector<rule_dep::NodeId> seeds{graph.find("common.h").value()};
+    auto affected = rule_dep::reverseReachable(graph, seeds, pool);
+    EXPECT_EQ(affected.size(), numObjects + 2);
+
+    seeds = {graph.find("7.c").value()};
+    EXPECT_EQ(names(graph, rule_dep::reverseReachable(graph, seeds, pool)),
+              (std::vector<std::string>{"7.o", "7.c", "app"}));
+}
+
+TEST(RuleDepTest, LevelizesAcyclicGraphs) {
+    RuleList rules{makeRule({"app"}, {"main.o", "util.o"}),
+                   makeRule({"main.o"}, {"main.c"}),
+                   makeRule({"util.o"}, {"util.c", "main.o"})};
+    rule_dep::Graph graph(rules);
+    auto levelization = rule_dep::levelize(graph, rules);
+    auto levelOf = [&](const std::string& name) {
+        return levelization.levelOf[graph.find(name).value()];
+    };
+    EXPECT_EQ(levelOf("main.c"), 0);
+    EXPECT_EQ(levelOf("main.o"), 1);
+    EXPECT_EQ(levelOf("util.o"), 2);
+    EXPECT_EQ(levelOf("app"), 3);
+    EXPECT_EQ(levelization.levels.size(), 4);
+    EXPECT_EQ(levelization.levels[0].size(), 2);
+}
+
+TEST(RuleDepTest, ReportsOneCyclePerComponentWithLineNumbers) {
+    RuleList rules{
+        std::make_shared<auto_var_replacement::Rule>(
+            std::vector<std::string>{"a"}, std::vector<std::string>{"b"},
+            std::vector<std::string>{}, 1),
+        std::make_shared<auto_var_replacement::Rule>(
+            std::vector<std::string>{"b"}, std::vector<std::string>{"a", "c"},
+            std::vector<std::string>{}, 3),
+        std::make_shared<auto_var_replacement::Rule>(
+            std::vector<std::string>{"c"}, std::vector<std::string>{"c"},
+            std::vector<std::string>{}, 5),
+    };
+    rule_dep::Graph graph(rules);
+    try {
+        rule_dep::levelize(graph, rules);
+        FAIL() << "cycle not detected";
+    } catch (const rule_dep::RuleDepException& e) {
+        std::string what = e.what();
+        EXPECT_NE(what.find("(2)"), std::string::npos) << what;
+        EXPECT_NE(what.find("c (line 5) -> c (line 5)"), std::string::npos)
+            << what;
+        bool ab = what.find("a (line 1) -> b (line 3) -> a (line 1)") !=
+                  std::string::npos;
+        bool ba = what.find("b (line 3) -> a (line 1) -> b (line 3)") !=
+                  std::string::npos;
+        EXPECT_TRUE(ab || ba) << what;
+    }
+}
+
+TEST(RuleDepTest, HandlesMillionNodeChainWithoutRecursion) {
+    constexpr size_t numNodes = 1000000;
+    RuleList rules;
+    rules.reserve(numNodes);
+    for (size_t i = 0; i + 1 < numNodes; i++) {
+        rules.emplace_back(
+            makeRule({std::to_string(i)}, {std::to_string(i + 1)}));
+    }
+    rule_dep::Graph graph(rules);
+    auto levelization = rule_dep::levelize(graph, rules);
+    EXPECT_EQ(levelization.levels.size(), numNodes);
+    EXPECT_EQ(levelization.levelOf[graph.find("0").value()], numNodes - 1);
+
+    // Closing the chain into one big cycle.
+    rules.emplace_back(makeRule({std::to_string(numNodes - 1)}, {"0"}));
+    rule_dep::Graph cyclic(rules);
+    EXPECT_EQ(rule_dep::stronglyConnectedComponents(cyclic).size(), 1);
+    EXPECT_THROW(rule_dep::levelize(cyclic, rules),
+                 rule_dep::RuleDepException);
+}
@@ -0,0 +1,53 @@
+#include "statement-codec.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+
+static std::vector<std::string> toStrings(
+    const std::vector<parser::Statement>& statements) {
+    std::vector<std::string> result;
+    for (const auto& s : statements) {
+        result.emplace_back(
+            std::visit([](const auto& t) { return t.toString(); }, s));
+    }
+    return result;
+}
+
+TEST(StatementCodecTest, RoundTripsEveryKindOfStatement) {
+    auto statements = parser::parseStatements(lexer::lexLines(
+        "CC = gcc $(FLAGS) $X\n"
+        "include a.mk b.mk\n"
+        "-include c.mk\n"
+        "$(DIR)/out: in\n"
+        "\t$(CC) -o $(DIR)/$@ $< $^ \"s $@ $(CC) $$HOME \\t\"x\n"));
+    std::string data = statement_codec::encode(statements);
+    auto decoded = statement_codec::decode(data);
+    EXPECT_EQ(toStrings(decoded), toStrings(statements));
+    EXPECT_EQ(statement_codec::encode(decoded), data);
+
+    const auto& rule = std::get<parser::Rule>(decoded[3]);
+    EXPECT_TRUE(std::get<lexer::Word>(rule.targets[1]).joined);
+    EXPECT_EQ(std::get<lexer::Word>(rule.targets[1]).lineno, 4);
+    const auto& str = std::get<lexer::String>(rule.recipes[0][7]);
+    EXPECT_EQ(str.lineno, 5);
+    EXPECT_FALSE(str.joined);
+    EXPECT_TRUE(std::get<lexer::Word>(rule.recipes[0][8]).joined);
+    EXPECT_TRUE(std::get<parser::Include>(decoded[2]).optional);
+}
+
+TEST(StatementCodecTest, RejectsCorruptedData) {
+    std::string data = statement_codec::encode(parser::parseStatements(
+        lexer::lexLines("A = 1\nall: a\n")));
+    EXPECT_THROW(statement_codec::decode(data.substr(0, data.size() - 1)),
+                 statement_codec::CodecException);
+    EXPECT_THROW(statement_codec::decode(data + "x"),
+                 statement_codec::CodecException);
+    EXPECT_THROW(statement_codec::decode("99999999999 d"),
+                 statement_codec::CodecException);
+}
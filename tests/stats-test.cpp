@@ -0,0 +1,59 @@
+#include "stats.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST(StatsTest, ScopeCountsAllocationsOfThePass) {
+    stats::AllocationCounting counting(true);
+    stats::Report report;
+    {
+        stats::Report::Scope scope(report, "alloc");
+        std::vector<std::unique_ptr<int>> ints;
+        for (int i = 0; i < 10; i++) {
+            ints.emplace_back(std::make_unique<int>(i));
+        }
+        scope.setItems(ints.size(), "ints");
+    }
+    ASSERT_EQ(report.passes.size(), 1);
+    const auto& pass = report.passes.front();
+    EXPECT_EQ(pass.name, "alloc");
+    EXPECT_GE(pass.allocations.allocations, 10);
+    EXPECT_GE(pass.allocations.bytes, 10 * sizeof(int));
+    EXPECT_EQ(pass.allocations.allocations, pass.allocations.deallocations);
+    EXPECT_EQ(pass.items, 10);
+}
+
+TEST(StatsTest, ReportIsSerializedAsJson) {
+    stats::Report report;
+    { stats::Report::Scope scope(report, "lex_parse"); }
+    report.workers = 4;
+    std::string json = report.toJson();
+    EXPECT_EQ(json.front(), '{');
+    EXPECT_EQ(json.back(), '}');
+    EXPECT_NE(json.find("\"name\":\"lex_parse\""), std::string::npos) << json;
+    EXPECT_NE(json.find("\"workers\":4"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"peak_rss_kib\":"), std::string::npos) << json;
+    EXPECT_GT(stats::peakRssKib(), 0);
+}
+
+TEST(StatsTest, CountingIsRestoredAfterwards) {
+    stats::Report report;
+    {
+        stats::AllocationCounting counting(true);
+        {
+            stats::AllocationCounting nested(false);
+            EXPECT_NE(report.toJson().find("\"allocation_counting\":true"),
+                      std::string::npos);
+        }
+        EXPECT_NE(report.toJson().find("\"allocation_counting\":true"),
+                  std::string::npos);
+    }
+    EXPECT_NE(report.toJson().find("\"allocation_counting\":false"),
+              std::string::npos);
+    stats::AllocationCounters before = stats::allocationCounters();
+    auto value = std::make_unique<int>(1);
+    EXPECT_EQ(stats::allocationCounters().allocations, before.allocations);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "auto-var-replacement.h"
+
+/**
+ * @brief Runs each test in a fresh temporary directory, which is the working
+ * directory for the duration of the test.
+ */
+class TempDirTest : public testing::Test {
+   protected:
+    std::filesystem::path workDir;
+    std::filesystem::path oldCwd;
+
+    void SetUp() override {
+        const auto* testInfo =
+            testing::UnitTest::GetInstance()->current_test_info();
+        workDir = std::filesystem::temp_directory_path() /
+                  ("tinymake-" + std::to_string(::getpid()) + "-" +
+                   testInfo->name());
+        std::filesystem::remove_all(workDir);
+        std::filesystem::create_directories(workDir);
+        oldCwd = std::filesystem::current_path();
+        std::filesystem::current_path(workDir);
+    }
+    void TearDown() override {
+        std::filesystem::current_path(oldCwd);
+        std::filesystem::remove_all(workDir);
+    }
+
+    static void writeFile(const std::filesystem::path& path,
+                          const std::string& content) {
+        std::ofstream(path) << content;
+    }
+    static std::string readFile(const std::filesystem::path& path) {
+        std::ifstream fin(path);
+        return {std::istreambuf_iterator<char>(fin), {}};
+    }
+    /**
+     * @brief Moves the mtime of `path` into the future, so that it is newer
+     * than everything built so far regardless of timestamp granularity.
+     */
+    static void touchLater(const std::filesystem::path& path) {
+        std::filesystem::last_write_time(
+            path, std::filesystem::file_time_type::clock::now() +
+                      std::chrono::seconds(10));
+    }
+};
+
+using RuleList = std::vector<std::shared_ptr<auto_var_replacement::Rule>>;
+
+inline std::shared_ptr<auto_var_replacement::Rule> makeRule(
+    const std::vector<std::string>& targets,
+    const std::vector<std::string>& prereqs,
+    const std::vector<std::string>& recipes = {"true"}) {
+    return std::make_shared<auto_var_replacement::Rule>(targets, prereqs,
+                                                        recipes, 1);
+}
@@ -0,0 +1,48 @@
+#include "thread-pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+TEST(ThreadPoolTest, RunsAllTasks) {
+    std::atomic<int> sum = 0;
+    {
+        thread_pool::ThreadPool pool(4);
+        for (int i = 1; i <= 100; i++) {
+            pool.submit([&sum, i] { sum += i; });
+        }
+    }
+    EXPECT_EQ(sum, 5050);
+}
+
+TEST(ThreadPoolTest, PropagatesResultsAndExceptions) {
+    thread_pool::ThreadPool pool(2);
+    auto value = pool.submit([] { return 42; });
+    auto failure = pool.submit([]() -> int { throw std::logic_error("x"); });
+    EXPECT_EQ(value.get(), 42);
+    EXPECT_THROW(failure.get(), std::logic_error);
+}
+
+TEST(ThreadPoolTest, ParallelForVisitsEveryIndexOnce) {
+    thread_pool::ThreadPool pool(4);
+    std::vector<int> visits(1000);
+    pool.parallelFor(visits.size(), [&visits](size_t i) { visits[i]++; });
+    EXPECT_EQ(visits, std::vector<int>(1000, 1));
+}
+
+TEST(ThreadPoolTest, ParallelForRethrowsAfterAllChunks) {
+    thread_pool::ThreadPool pool(4);
+    std::atomic<int> done = 0;
+    EXPECT_THROW(pool.parallelFor(100,
+                                  [&done](size_t i) {
+                                      if (i == 99) {
+                                          throw std::logic_error("x");
+                                      }
+                                      done++;
+                                  }),
+                 std::logic_error);
+    EXPECT_EQ(done, 99);
+}
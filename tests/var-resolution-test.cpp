@@ -0,0 +1,82 @@
+#include "var-resolution.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "auto-var-replacement.h"
+#include "lexer.h"
+#include "parser.h"
+#include "var-replacement.h"
+
+TEST(VarResolutionTest, ExpandsRecursivelyAndLastDefinitionWins) {
+    auto [varDefs, rules] = parser::parse(lexer::lex(
+        "A = $(B) x\n"
+        "B = 1\n"
+        "B = 2 $(C)\n"));
+    auto variables = var_resolution::resolveVariables(varDefs);
+    EXPECT_EQ(variables["A"], (std::vector<std::string>{"2", "x"}));
+    EXPECT_EQ(variables["B"], (std::vector<std::string>{"2"}));
+}
+
+TEST(VarResolutionTest, RejectsSelfReference) {
+    auto [varDefs, rules] = parser::parse(lexer::lex("A = $(B)\nB = $(A)\n"));
+    EXPECT_THROW(var_resolution::resolveVariables(varDefs),
+                 var_resolution::VarResolutionException);
+}
+
+TEST(VarResolutionTest, ReplacesVariablesAndAutomaticVariables) {
+    auto [varDefs, rules] = parser::parse(lexer::lex(
+        "CC = gcc\n"
+        "SRCS = a.c b.c\n"
+        "\n"
+        "out: $(SRCS) a.c\n"
+        "\t$(CC) -o $@ $^\n"
+        "\techo $< \"built $@ with $(CC)\"\n"));
+    auto variables = var_resolution::resolveVariables(varDefs);
+    auto rule = auto_var_replacement::replace(var_replacement::replace(
+        std::make_shared<parser::Rule>(rules[0]), variables));
+    EXPECT_EQ(rule->targets, (std::vector<std::string>{"out"}));
+    EXPECT_EQ(rule->prereqs, (std::vector<std::string>{"a.c", "b.c", "a.c"}));
+    EXPECT_EQ(rule->recipes,
+              (std::vector<std::string>{"gcc -o out a.c b.c",
+                                        "echo a.c \"built out with gcc\""}));
+    EXPECT_EQ(rule->lineno, 4);
+}
+
+TEST(VarResolutionTest, KeepsWordsWrittenWithoutSpaces) {
+    auto [varDefs, rules] = parser::parse(lexer::lex(
+        "DIR = build\n"
+        "X = inc\n"
+        "FLAGS = -I$(X) -O2\n"
+        "EMPTY =\n"
+        "\n"
+        "$(DIR)/$(X).o: $(DIR)/a.c -I$(X) a$(EMPTY)b c $(EMPTY)d\n"
+        "\tcc $(FLAGS) -c $< -o $(DIR)/$@ $@.o \"$@\".d $$HOME\n"));
+    auto variables = var_resolution::resolveVariables(varDefs);
+    EXPECT_EQ(variables["FLAGS"], (std::vector<std::string>{"-Iinc", "-O2"}));
+    auto rule = auto_var_replacement::replace(var_replacement::replace(
+        std::make_shared<parser::Rule>(rules[0]), variables));
+    EXPECT_EQ(rule->targets, (std::vector<std::string>{"build/inc.o"}));
+    EXPECT_EQ(rule->prereqs, (std::vector<std::string>{"build/a.c", "-Iinc",
+                                                       "ab", "c", "d"}));
+    EXPECT_EQ(rule->recipes,
+              (std::vector<std::string>{
+                  "cc -Iinc -O2 -c build/a.c -o build/build/inc.o "
+                  "build/inc.o.o \"build/inc.o\".d $HOME"}));
+}
+
+TEST(VarResolutionTest, QuotedStringsLeaveOnlyDoubledDollarsToTheShell) {
+    auto [varDefs, rules] = parser::parse(lexer::lex(
+        "V = a$$b\n"
+        "out: in\n"
+        "\techo \"$$HOME $(V) $@ `x` \\\\\"\n"));
+    auto variables = var_resolution::resolveVariables(varDefs);
+    auto rule = auto_var_replacement::replace(var_replacement::replace(
+        std::make_shared<parser::Rule>(rules[0]), variables));
+    EXPECT_EQ(rule->recipes,
+              (std::vector<std::string>{
+                  "echo \"$HOME a\\$b out \\`x\\` \\\\\""}));
+}